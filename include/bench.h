@@ -0,0 +1,51 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+/* Flash benchmark.
+ *
+ * Programs and erases a scratch block at the top of the program's share of
+ * the flash (see F_PROG_SIZE) at a few batch sizes and alignments, the same
+ * way the log does: one call per task with fLock held. Each call is timed
+ * with interrupts off, and the IMU timer's missed ticks are counted over
+ * each case, so the stalls can be checked against CIRC_BUF and
+ * FLASH_PERIOD_MS on a real board.
+ *
+ * The scratch block is left erased. Nothing else in the log is touched, but
+ * the stalls are real, so dont run it in flight.
+ *
+ * The sampler's filters are timed as well, see benchFilters. */
+
+#define BENCH_CASES 6
+
+#define BENCH_FILTER_STEPS 1000
+
+typedef struct {
+    char     op;          // 'p' program, 'e' erase
+    uint32_t len;         // Bytes per call
+    uint32_t offs;        // How far out of line with len the calls start
+    uint32_t calls;
+    uint32_t minUs, maxUs, totalUs;   // Per call, interrupts off
+    uint32_t missed;      // IMU timer ticks missed over the case
+} bench_t;
+
+/* Starts the benchmark in the background, on the main task list.
+ * Returns 0 on success, 1 if the program runs into the scratch block, 2 if
+ * its already running. */
+uint8_t benchStart(void);
+
+/* Returns how far through the benchmark we are, in percent. 100 if it
+ * isnt running. */
+int benchProgress(void);
+
+/* Copies the results of case n into out.
+ * Returns 0 on success, 1 if theres no such case. */
+int benchGet(int n, bench_t * out);
+
+/* Times BENCH_FILTER_STEPS steps of a biquad and a moving average the
+ * shape of the sampler's, with interrupts off, and gets the cycles per
+ * step of each including the call and the loop. About a ms of stall. */
+void benchFilters(uint32_t * biquadCyc, uint32_t * maCyc);
+
+#endif
@@ -36,4 +36,18 @@
 // Buzzer
 #define BOB_BUZZER 7
 
+// LoRa radio on spi0. pico-lora's wiring, with MISO and DIO0 moved off the
+// I2C bus and the buzzer.
+#define BOB_LORA_SCK   18
+#define BOB_LORA_MOSI  19
+#define BOB_LORA_MISO  20
+#define BOB_LORA_CS    8
+#define BOB_LORA_RESET 9
+#define BOB_LORA_DIO0  21
+
+// NMEA GPS on uart1
+#define BOB_GPS_UART 1
+#define BOB_GPS_TX   4
+#define BOB_GPS_RX   5
+
 #endif
@@ -0,0 +1,11 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <stdint.h>
+
+/* Standard CRC-32 (the one zlib and Ethernet use).
+ * Start with crc = 0, then feed the result of each call into the next to
+ * checksum data in pieces. */
+uint32_t crc32(uint32_t crc, const void * data, uint32_t len);
+
+#endif
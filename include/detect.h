@@ -0,0 +1,57 @@
+#ifndef DETECT_H
+#define DETECT_H
+
+#include <stdint.h>
+
+#include "types.h"
+
+/* Flight event detection. Drives state from BOOT through to LANDED.
+ *
+ * The sampler hands every processed sample straight to detectImu or
+ * detectBaro from the task that read it, so a sample never waits on
+ * another task before it is looked at. The worst case from a sample being
+ * taken to the state changing is then:
+ *  - for the IMU, the time it sat in the FIFO, which is up to a read
+ *    period (about half of IMU_BATCH samples) and more if the read task
+ *    ran late
+ *  - the I2C reads of the batch it came in
+ *  - the time its I2C callback waits at TL_HIGH, which is bounded by the
+ *    longest task on that core (a flash page program, or a sector erase if
+ *    one is running)
+ *  - a few us of detection.
+ *
+ * That latency is measured for every sample from when it was taken: the
+ * IMU's own sample time for each FIFO sample, and the end of the I2C read
+ * for the baro, which only ever has the one. The worst so far is kept for
+ * each sensor, and every state change is logged as an EVENT with the
+ * latency of the sample that caused it.
+ *
+ *  BOOT        -> GROUNDED     Once the filters have had time to settle
+ *  GROUNDED    -> BOOST        acclFilt held over 3 g
+ *  BOOST       -> COAST        acclFilt held under 2 g (burnout)
+ *  COAST       -> DROGUE_FIRE  vVel stops going up (apogee)
+ *  DROGUE_FIRE -> DROGUE_OUT   After DETECT_FIRE_MS
+ *  DROGUE_OUT  -> MAIN_FIRE    Pressure over conf_t.mainPres, if its set
+ *                              (shell `e` sets it off a deploy altitude)
+ *  MAIN_FIRE   -> MAIN_OUT     After DETECT_FIRE_MS
+ *  MAIN_OUT    -> LANDED       vVel settled at 0. From DROGUE_OUT when
+ *                              theres no main. */
+
+// How long the fire states are held for
+#define DETECT_FIRE_MS 1000
+
+/* Starts detection again from BOOT, using the deployment settings in cfg */
+void detectInit(const conf_t * cfg);
+
+/* Runs detection on a processed IMU sample. arrivalUs is time_us_32 when
+ * the IMU took the sample, worked out from its FIFO timestamp. */
+void detectImu(const imu_t * imu, uint32_t arrivalUs);
+
+/* Runs detection on a processed baro sample. arrivalUs is time_us_32 when
+ * the read it came from finished. */
+void detectBaro(const baro_t * baro, uint32_t arrivalUs);
+
+/* Gets the worst latency seen so far from each sensor, in us */
+void detectLatency(uint32_t * imuUs, uint32_t * baroUs);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "types.h"
+
+/* Fixed point attitude and altitude estimation, fed by the sampler.
+ *
+ * Attitude is a Mahony filter on a Q30 quaternion. The gyro is integrated
+ * every IMU sample, and the accelerometer pulls the attitude back towards
+ * gravity, but only while it reads close to 1 g; under thrust or drag it
+ * isnt measuring gravity at all. The compass only ever corrects yaw, so a
+ * badly calibrated one cant tip the attitude over.
+ *
+ * Altitude is a two state (altitude, vertical velocity) Kalman filter with
+ * its gains worked out ahead of time for the steady state. It predicts off
+ * the vertical acceleration every IMU sample and corrects off the baro, so
+ * it doesnt lag the way the baro filter does.
+ *
+ * The body frame is the IMU's. Earth's frame has z up, and x at magnetic
+ * north once the compass has had a chance to settle.
+ *
+ * Everything is integer. Most of the cost is the 64 bit multiplies the
+ * Q30 maths needs, which the M0+ does in software; estImu is traced as
+ * TR_EST, so check that on the board against the IMU period. */
+
+/* Resets the estimator for an IMU sampling every dtUs, up to 64 ms. The
+ * next IMU sample sets the attitude straight off gravity and the next baro
+ * sample sets the pad's altitude. */
+void estInit(uint32_t dtUs);
+
+/* Steps the attitude and altitude on by one IMU sample, calibrated */
+void estImu(const int16_t accl[3], const int16_t gyro[3]);
+
+/* Corrects yaw off a calibrated compass sample */
+void estComp(const int16_t mag[3]);
+
+/* Corrects altitude off a baro sample. While pad is set the pad's altitude
+ * follows the baro, so the estimate stays relative to where it launched. */
+void estBaro(uint32_t pres, bool pad);
+
+/* Gets the current estimate as a log record */
+est_t estGet(uint32_t time);
+
+/* Works out the pressure cm above where the baro reads pres, off the same
+ * standard atmosphere as the estimate. Used to set conf_t.mainPres from a
+ * deploy altitude. */
+uint32_t estPresAbove(uint32_t pres, int32_t cm);
+
+#endif
@@ -4,9 +4,35 @@
 #include "types.h"
 
 /* Implements a simple journaling system in flash
- * Uses a circular buffer to store data ahead of it being written.
- * This allows us to store a period of data from before launch, and write it
- * in flight. */
+ * Uses a lock-free ring (see ring.h) to store data ahead of it being written.
+ * While BOOT or GROUNDED nothing is written; the ring keeps the last few
+ * seconds and the oldest records are thrown away. Once the sampler detects
+ * launch, that whole pre-trigger window is flushed to flash first, then the
+ * log carries on live. After landing it carries on for F_LANDED_MS, at the
+ * sampler's reduced LANDED rates, then the session is closed and its back
+ * to keeping the last few seconds.
+ *
+ * The log is written a page at a time and every used page starts with a
+ * record, so the end of the log can be found with a binary search over the
+ * pages. Each sector starts with a SECT record.
+ *
+ * In ring mode the log wraps round and overwrites its oldest sectors
+ * instead of stopping when its full, so erases are spread over the whole
+ * log and the newest data is always kept. Sector seqs give the order, and
+ * fRewind starts from the oldest sector. Sessions that have been written
+ * over will read back newer data. Wipe the flash after switching modes.
+ *
+ * Ahead of the log is a directory with an entry for each session (flight).
+ * A session is opened by the first page written after boot or fEndSession,
+ * and is always page aligned. */
+
+// The program gets the first F_PROG_SIZE bytes of the flash. The config,
+// the session directory and the log come after it.
+#define F_PROG_SIZE (1024 * 1024)
+
+// How long the log carries on after landing, so it shows the rocket
+// settled and the GPS fix where it came down
+#define F_LANDED_MS (2 * 60 * 1000)
 
 enum types {
     BARO = 'b', // baro_t
@@ -14,29 +40,99 @@ enum types {
     COMP = 'c', // comp_t
     CFG  = 'C', // conf_t
     GPS  = 'g', // gps_t
-    MSG  = 'm'  // ASCII Message <= 255 Chars
+    EVENT = 'e', // event_t, a state change
+    EST  = 'q', // est_t, attitude and altitude
+    SECT = 's', // sect_t, always the first record in a sector
+    DELTA = 'z', // Base type then zig-zag varint deltas of an imu_t, comp_t
+                 // or baro_t from the last of its type. See fNext.
+    MSG  = 'm'  // ASCII Message <= 253 Chars (records must fit in a page)
 };
 
-/* Reads the next log from the flash and puts it into buf */
+// A session directory entry. Addresses are flash addresses.
+typedef struct {
+    uint32_t start;       // First page of the session
+    uint32_t time;        // ms from boot when it started
+    // Filled in when the session is closed
+    uint32_t end;         // Page after the last one
+    uint32_t records;     // Records logged, 0xFFFFFFFF if never closed
+} session_t;
+
+/* Gets the next log in flash without copying it. Logs are read in order,
+ * so the XIP cache does most of the work.
+ * Returns:
+ * A pointer to the log, valid until the next call. Only the first
+ *   TRUE_SIZE of it (3 + size) is the log. DELTA records are expanded.
+ * NULL if there are no more logs. */
+const log_t * fNext(void);
+
+/* Reads the next log from the flash and puts it into buf.
+ * DELTA records are expanded, so buf never holds a DELTA. */
 int fRead(log_t * buf);
 
-/* Creates a log from the data in buf and pushes it to the circular buffer
- * N.B. May overwrite data if the circular buffer is full. */
-void fPush(uint8_t * buf, uint8_t size, enum types type);
+/* Creates a log from the data in buf and pushes it to the sample ring.
+ * Safe to call from an IRQ, but only one context may push at a time.
+ * N.B. The record is dropped if the ring is full; see fDropped. */
+void fPush(const void * buf, uint8_t size, enum types type);
+
+/* Returns the number of records dropped because the sample ring was full */
+uint32_t fDropped(void);
 
 /* Writes a log direct to flash, skipping the buffer.  */
-void fWrite(uint8_t * buf, uint8_t size, enum types type);
+void fWrite(const void * buf, uint8_t size, enum types type);
 
 /* Puts the read pointer back at the start */
 void fRewind(void);
 
+/* Flushes everything logged so far and closes the current session */
+void fEndSession(void);
+
+/* Returns the number of sessions in the directory */
+int fSessions(void);
+
+/* Copies a session's directory entry into sess.
+ * Returns 0 on success, 1 if theres no such session. */
+int fGetSession(int n, session_t * sess);
+
+/* Points the read pointer at a session, so fNext only returns its records
+ * until the next fRewind.
+ * Returns 0 on success, 1 if theres no such session. */
+int fSeekSession(int n);
+
+/* Gets the raw log, from the start up to the last page written.
+ * Returns a pointer to the start of the log, with its length in bytes put in
+ * len. The log starts page aligned. */
+const uint8_t * fRawLog(uint32_t * len);
+
 /* Returns total flash used in kiB */
 int fUsed(void);
 
-/* Erases all data in the flash. Returns the expected time in ms. */
+/* Loads the newest config saved in flash into cfg.
+ * Returns 0 on success, 1 if there isnt one. */
+int fLoadConfig(conf_t * cfg);
+
+/* Saves cfg to flash. It is kept separately from the log, so fErase doesnt
+ * touch it. */
+void fSaveConfig(const conf_t * cfg);
+
+/* Starts erasing the log in the background, a sector per task. The config
+ * is left alone. New logs are written as soon as their sectors are ready. */
 void fErase(void);
 
-/* Spins up the flash task and associated timers. */
-void fInit(void);
+/* Returns how far through an erase we are, in percent. 100 if there isnt
+ * one running. */
+int fEraseProgress(void);
+
+/* Keeps everything off the flash until fUnlock, for anything else that
+ * needs to program or erase it. Interrupts are off, and in dual core mode
+ * the sampler core is parked in RAM, so keep it short.
+ * Returns the interrupt state to hand to fUnlock. */
+int fLock(void);
+
+/* Lets everything back onto the flash */
+void fUnlock(int ints);
+
+/* Spins up the flash task and associated timers. cfg->ringLog picks between
+ * a linear log and a ring log. */
+void fInit(const conf_t * cfg);
 
 #endif
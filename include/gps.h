@@ -0,0 +1,32 @@
+#ifndef GPS_H
+#define GPS_H
+
+#include <stdint.h>
+
+#include "taskList.h"
+
+/* NMEA GPS on a UART.
+ *
+ * The UART's RX IRQ only moves bytes from its FIFO into a ring. Sentences
+ * are put together from the ring by a TL_LOW task, one sentence per run, so
+ * a burst of NMEA never holds up the sensor tasks. Only GGA and RMC are
+ * decoded, with the fast decoders in nmea.h, and each GGA is logged as a
+ * GPS record.
+ *
+ * The UART runs at the receiver's default 9600 baud, so expect its default
+ * 1 Hz fix. See GPS_BAUD in gps.c for going faster.
+ *
+ * gpsData holds the latest fix, with lat and lon in 1e-7 degrees. */
+
+/* Starts listening to the GPS. gpsTask is added to tl and the UART IRQ runs
+ * on the calling core. As GPS records are pushed to the sample ring, tl
+ * must belong to the same core as the sensors. */
+void gpsInit(taskList_t * tl);
+
+/* Returns the number of bytes lost because the ring was full */
+uint32_t gpsDropped(void);
+
+/* Returns the number of sentences that failed to parse or checksum */
+uint32_t gpsBad(void);
+
+#endif
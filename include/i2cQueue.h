@@ -0,0 +1,64 @@
+#ifndef I2CQUEUE_H
+#define I2CQUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <hardware/i2c.h>
+
+#include "taskList.h"
+
+/* An interrupt driven I2C transaction queue.
+ *
+ * Transactions are queued up with iqSubmit and run back to back by the I2C
+ * IRQ, so nothing waits on the bus. Once a transaction is done its callback
+ * is added to the task list at TL_HIGH with the transaction as its data
+ * pointer, and doneUs says when it finished so the callback knows how long
+ * it waited.
+ *
+ * A transaction writes txLen bytes, then (after a repeated start) reads
+ * rxLen bytes, then stops. Either length can be 0.
+ *
+ * Once iqInit has been called the queue owns the bus. The blocking driver
+ * functions may still be used from a task, but only after iqFlush. */
+
+#define IQ_SIZE 16
+
+// Transaction status codes
+#define IQ_BUSY   1  // Queued or running
+#define IQ_OK     0
+#define IQ_ERROR -2  // Lines up with PICO_ERROR_GENERIC
+
+typedef struct {
+    uint8_t addr;
+    const uint8_t * tx;
+    uint8_t txLen;
+    uint8_t * rx;
+    uint8_t rxLen;
+    void (*callback) (void * );  // Runs as a task once done. May be NULL.
+    volatile int8_t status;
+    uint32_t doneUs;             // time_us_32 when it finished
+} iq_txn_t;
+
+/* Hands the bus over to the queue. Completed transactions have their
+ * callbacks added to tl. */
+void iqInit(i2c_inst_t * i2c, taskList_t * tl);
+
+/* Fills in a transaction. Buffers must outlive the transaction. */
+void iqSetup(iq_txn_t * txn, uint8_t addr,
+             const uint8_t * tx, uint8_t txLen,
+             uint8_t * rx, uint8_t rxLen,
+             void (*callback) (void * ));
+
+/* Queues a transaction.
+ * Returns:
+ * 0 on success
+ * 1 if the queue is full or txn is already queued */
+uint8_t iqSubmit(iq_txn_t * txn);
+
+/* Returns true if nothing is queued or running */
+bool iqIdle(void);
+
+/* Waits for everything queued to finish */
+void iqFlush(void);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef NMEA_H
+#define NMEA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "types.h"
+
+/* Fast decoders for the NMEA sentences the GPS logs.
+ *
+ * minmea parses every sentence through a format string and varargs, and
+ * builds floats we only turn back into integers. These go straight from
+ * the text into gps_t in one pass over the fields, with no allocation, no
+ * format strings and no division by anything but constants.
+ *
+ * nmeaId checks a sentence the same way minmea_check does in strict mode, so
+ * the decoders can assume the checksum is good. They still check each field
+ * they use, and leave gps alone if any of them is malformed.
+ *
+ * Coordinates come out in 1e-7 degrees, truncated towards 0 the same way as
+ * converting minmea's output. */
+
+// The longest sentence NMEA 0183 allows, with the $ and the \r\n
+#define NMEA_MAX_LENGTH 82
+
+enum nmeaSentence {
+    NMEA_INVALID = -1,
+    NMEA_UNKNOWN = 0,
+    NMEA_GGA,
+    NMEA_RMC
+};
+
+/* Checks a sentence's checksum and works out what it is.
+ * Returns:
+ * NMEA_INVALID if it isnt a checksummed NMEA sentence
+ * NMEA_UNKNOWN if it is one we dont decode
+ * Otherwise the sentence type, from any talker */
+enum nmeaSentence nmeaId(const char * s);
+
+/* Decodes a GGA into gps. The time and satellite count are always filled
+ * in; the position only if there is a fix.
+ * Returns true on success, false if a field is malformed. */
+bool nmeaGga(gps_t * gps, const char * s);
+
+/* Decodes an RMC into gps. Only the time and position are filled in, and
+ * only if the fix is valid.
+ * Returns true on success, false if a field is malformed. */
+bool nmeaRmc(gps_t * gps, const char * s);
+
+#endif
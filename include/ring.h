@@ -0,0 +1,58 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A lock-free single producer, single consumer ring of variable length
+ * records.
+ *
+ * The producer reserves space, writes its record straight into the ring,
+ * then commits it. The consumer peeks at the oldest data and releases it
+ * once it is done with it. Only the producer moves head and only the
+ * consumer moves tail, so neither side needs to disable interrupts, and
+ * either side can be an IRQ handler as long as there is only one of each.
+ *
+ * Reservations are always contiguous. If a record wont fit before the end of
+ * the buffer, the producer leaves a gap and starts again from the beginning.
+ * Nothing is ever overwritten; if there is no room the reservation fails and
+ * it is up to the consumer to make room. */
+
+typedef struct {
+    uint8_t * buf;
+    uint32_t size;
+    volatile uint32_t head;    // Next byte to write. Producer only.
+    volatile uint32_t tail;    // Next byte to read. Consumer only.
+    volatile uint32_t wrap;    // End of valid data before the producer wrapped
+    uint32_t dropped;          // Number of failed reservations
+    bool wrapPending;          // Producer only.
+} ring_t;
+
+/* Initialises a ring using size bytes of buf as storage */
+void ringInit(ring_t * ring, uint8_t * buf, uint32_t size);
+
+/* Reserves len contiguous bytes for the producer to write into.
+ * Returns:
+ * A pointer to the reserved space on success
+ * NULL if there is no room. The record is counted as dropped. */
+uint8_t * ringReserve(ring_t * ring, uint32_t len);
+
+/* Publishes the last reservation to the consumer. len must be the size
+ * that was reserved. */
+void ringCommit(ring_t * ring, uint32_t len);
+
+/* Gets the oldest data in the ring without removing it.
+ * Returns:
+ * A pointer to the oldest data, with the number of contiguous bytes
+ * available put into len.
+ * NULL if the ring is empty. */
+uint8_t * ringPeek(ring_t * ring, uint32_t * len);
+
+/* Frees len bytes from the tail of the ring. Must not be more than the last
+ * ringPeek returned. */
+void ringRelease(ring_t * ring, uint32_t len);
+
+/* Returns the number of bytes waiting in the ring */
+uint32_t ringUsed(ring_t * ring);
+
+#endif
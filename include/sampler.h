@@ -4,8 +4,25 @@
 #include <pico/stdlib.h>
 #include <stdint.h>
 
-/* Initialises the sensors and the associated i2c bus */
-void configureSensors(void);
+#include "taskList.h"
+#include "types.h"
+
+// Number of built in flight profiles
+#define N_PROFILES 3
+
+/* Copies the sensor settings from a built in profile into cfg.
+ * Returns 0 on success, 1 if theres no such profile. */
+uint8_t sensorProfile(uint8_t id, conf_t * cfg);
+
+/* Initialises the sensors and the associated i2c bus using the sensor
+ * settings in cfg. The sensor timers and IRQs run on the calling core, and
+ * their tasks are added to tl, so tl must only be run by that core too. */
+void configureSensors(const conf_t * cfg, taskList_t * tl);
+
+/* Gets how many ticks the IMU timer has missed since boot, because
+ * something kept interrupts off for longer than a period. Its period in us
+ * is put in periodUs. */
+uint32_t sensorMissed(uint32_t * periodUs);
 
 
 #endif
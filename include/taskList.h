@@ -6,6 +6,16 @@
 #define TL_SIZE   64
 #define TL_MAX_T  64
 
+/* Tasks are queued in one FIFO per priority. tlRun always takes the oldest
+ * task from the highest priority queue that has one, so a flood of low
+ * priority work (like the shell printing) can never hold up the sampler. */
+enum tlPrio {
+    TL_HIGH = 0,  // Sensor reads and I2C callbacks
+    TL_NORM,      // Flash and anything added with tlAdd
+    TL_LOW,       // Shell and console output
+    TL_PRIOS
+};
+
 typedef struct {
     void (*taskPtr) (void * );
     void * dataPtr;
@@ -14,7 +24,12 @@ typedef struct {
 typedef struct {
     uint8_t head;
     uint8_t tail;
+    uint32_t dropped;     // Tasks turned away because the queue was full
     task_t tasks[TL_SIZE];
+} tlQueue_t;
+
+typedef struct {
+    tlQueue_t queues[TL_PRIOS];
 } taskList_t;
 
 /* Initialises a blank task list */
@@ -27,7 +42,13 @@ taskList_t tlInit(void);
  */
 uint8_t tlRun(taskList_t * tl);
 
-/* Adds an item to the task list
+/* Sleeps until the next interrupt, unless something is already waiting to
+ * run. Call it when tlRun has nothing to do. Only the interrupts of the
+ * core that runs tl can wake it, so tasks must only be added to tl from
+ * that core. */
+void tlIdle(taskList_t * tl);
+
+/* Adds an item to the task list at TL_NORM priority
  * Parameters:
  * tl - The task list
  * taskPtr - A function pointer
@@ -38,7 +59,23 @@ uint8_t tlRun(taskList_t * tl);
  */
 uint8_t tlAdd(taskList_t * tl, void (*taskPtr) (void * ), void * dataPtr);
 
-/* Returns the number of items in a task list */
+/* Adds an item to the task list at the given priority
+ * Parameters:
+ * tl - The task list
+ * prio - Which queue to add it to
+ * taskPtr - A function pointer
+ * dataPtr - a pointer that will be passed to taskPtr when run
+ * Returns:
+ * 0 on success
+ * 1 if no room remains in that priority's queue
+ */
+uint8_t tlAddPrio(taskList_t * tl, enum tlPrio prio,
+                  void (*taskPtr) (void * ), void * dataPtr);
+
+/* Returns the number of items in a task list, across all priorities */
 uint8_t tlSize(taskList_t * tl);
 
+/* Returns the number of tasks dropped at the given priority */
+uint32_t tlDropped(taskList_t * tl, enum tlPrio prio);
+
 #endif
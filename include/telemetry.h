@@ -0,0 +1,86 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#include "taskList.h"
+
+/* LoRa telemetry downlink.
+ *
+ * Frames are packed from the latest baroData, imuData, gpsData and state,
+ * DMA'd into the radio's FIFO in one burst, and the DMA IRQ starts the
+ * transmission. The radio's DIO0 says when it is done. Nothing ever waits
+ * on the radio, so if the last frame is still going out when the next is
+ * due, the new one is skipped.
+ *
+ * The link runs on one of TELEM_LINKS profiles, from fast (0) to long
+ * range (TELEM_LINKS - 1). Each profile sends frames as often as its share
+ * of airtime allows; the slower ones send the smaller telemShort_t. On the
+ * pad the link starts on the fastest profile, and at apogee it drops to
+ * the longest range one.
+ *
+ * After each frame the radio listens for an ack from the ground: a
+ * TELEM_ACK byte then the frame's seq. Acks move the link one profile
+ * slower when the SNR margin gets thin, and one faster after a run of
+ * strong ones, but never faster than profile 1 once past apogee. After
+ * TELEM_MISSES missed acks it drops to the longest range profile. Without
+ * any acks, only the flight phase picks the profile.
+ *
+ * Changes are announced first. Each frame's link byte has the profile it
+ * was sent on (bits 0-1), the profile it is changing to (bits 2-3) and how
+ * many frames are left on the old one (bits 4-7). The ground should switch
+ * once that reaches 0, or fall back to the longest range profile after
+ * TELEM_LOST_MS without a frame.
+ *
+ * If theres no radio fitted, telemInit says so and everything else does
+ * nothing. */
+
+#define TELEM_LINKS   3
+#define TELEM_ACK     0xA5
+#define TELEM_MISSES  5
+#define TELEM_LOST_MS 10000
+
+#define TELEM_LINK(cur, next, left) ((cur) | (next) << 2 | (left) << 4)
+
+// A full telemetry frame. Little endian, like everything else on the RP2040.
+typedef struct __attribute__((packed)) {
+    uint8_t  seq;         // Counts up per frame, so the ground can see gaps
+    uint8_t  link;        // See above
+    uint8_t  state;       // enum states
+    uint32_t time;        // ms from boot
+    uint32_t pres;        // Pascals
+    int16_t  vVel;        // baro_t.vVel
+    uint16_t acclFilt;    // imu_t.acclFilt, saturated
+    int32_t  lat, lon;    // gps_t
+    uint8_t  sats;
+} telem_t;
+
+// The short frame sent on slow profiles. Told apart by its length.
+typedef struct __attribute__((packed)) {
+    uint8_t  seq;
+    uint8_t  link;
+    uint8_t  state;
+    uint32_t pres;
+    int16_t  vVel;
+    int32_t  lat, lon;
+} telemShort_t;
+
+typedef struct {
+    uint32_t sent;        // Frames sent
+    uint32_t skipped;     // Frames skipped because the radio was busy
+    uint32_t acks;        // Acks heard
+    uint8_t  link;        // Profile in use
+    uint16_t periodMs;    // and how often it sends
+    int16_t  rssi;        // Of the last ack, dBm
+    int8_t   snr;         // Of the last ack, quarter dB
+} telemStats_t;
+
+/* Sets up the radio and starts sending. Tasks and IRQs belong to the
+ * calling core.
+ * Returns 0 on success, 1 if theres no radio. */
+uint8_t telemInit(taskList_t * tl);
+
+/* Gets the link's stats */
+void telemStats(telemStats_t * stats);
+
+#endif
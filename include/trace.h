@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include <hardware/timer.h>
+
+/* Lightweight timing of the hot paths.
+ *
+ * Each traced section takes a traceStart timestamp off the 1 us RP2040
+ * timer on the way in and hands it to traceEnd on the way out, which keeps
+ * the count, min, max, total and a histogram for that section. That is two
+ * timer reads and a few adds, about 1 us on an M0+.
+ *
+ * Each section must only ever be traced from one core, and never from an
+ * IRQ and a task at once. Nothing is locked; a reset racing a traceEnd can
+ * lose that one sample.
+ *
+ * The task lists' depth is sampled before every tlRun, and the high water
+ * mark kept. */
+
+// Histogram buckets double from TRACE_MIN_US up; the last catches the rest
+#define TRACE_BUCKETS 10
+#define TRACE_MIN_US  16
+
+enum traceId {
+    TR_FTASK = 0,     // fTask
+    TR_IRQS_OFF,      // Interrupts off around a flash program or erase
+    TR_QMI_TASK,      // qmiTask
+    TR_QMI_DONE,      // qmiDone
+    TR_HP_END,        // hpEndTask
+    TR_HP_DONE,       // hpEndDone
+    TR_DUMP,          // dumpTask
+    TR_EST,           // estImu, once per IMU sample
+    TR_IDS
+};
+
+enum traceList {
+    TQ_MAIN = 0,      // tl
+    TQ_SENSOR,        // The sampler's own list on core 1, if it has one
+    TQ_LISTS
+};
+
+typedef struct {
+    uint32_t count;
+    uint32_t min, max;    // us
+    uint32_t total;       // us, for the mean
+    uint32_t hist[TRACE_BUCKETS];
+} traceStat_t;
+
+/* Returns the timestamp to hand to traceEnd */
+static inline uint32_t traceStart(void) {
+    return time_us_32();
+}
+
+/* Records a section that started at start */
+void traceEnd(enum traceId id, uint32_t start);
+
+/* Records a task list's depth */
+void traceDepth(enum traceList list, uint8_t depth);
+
+/* Gets a copy of a section's stats */
+void traceGet(enum traceId id, traceStat_t * stat);
+
+/* Returns the deepest a task list has been */
+uint8_t traceDepthMax(enum traceList list);
+
+/* Returns the name of a section, for printing */
+const char * traceName(enum traceId id);
+
+/* Clears everything */
+void traceReset(void);
+
+#endif
@@ -11,7 +11,7 @@
 
 #define CFG_TUD_CDC             (1)
 #define CFG_TUD_CDC_RX_BUFSIZE  (256)
-#define CFG_TUD_CDC_TX_BUFSIZE  (256)
+#define CFG_TUD_CDC_TX_BUFSIZE  (1024)  // Big enough for a binary dump frame
 
 // We use a vendor specific interface but with our own driver
 #define CFG_TUD_VENDOR            (0)
@@ -4,39 +4,97 @@
 #include <stdint.h>
 
 /* Defines types for this project so we arent constantly pulling in whole
- * modules for no reason. Also avoids circular dependencies */
+ * modules for no reason. Also avoids circular dependencies
+ *
+ * Anything that ends up in a log is packed, so that a log_t in memory is
+ * byte-for-byte what gets stored, and no RAM or flash is spent on padding. */
 
-typedef struct {
+typedef struct __attribute__((packed)) {
     uint32_t time;        // ms from boot
     // Raw data
     uint32_t pres;        // Pascals
     int32_t  temp;        // CentiDegrees
     // Filtered
-    int32_t  vVel;        // Arbitrary units
+    int32_t  vVel;        // About m/s, negative going up
 } baro_t;
 
-typedef struct {
+// Standard gravity in the accelerometer's units
+#define G_CMSS 981
+
+typedef struct __attribute__((packed)) {
     uint32_t time;        // ms from boot
-    int16_t  compass[3];  // Arbitrary units
+    int16_t  compass[3];  // 10s of nT, calibrated
 } comp_t;
 
-typedef struct {
+typedef struct __attribute__((packed)) {
     uint32_t time;        // ms from boot
-    // Raw
-    int16_t  accl[3];     // Arbitrary units
-    int16_t  gyro[3];     // Arbitrary units
+    // Calibrated
+    int16_t  accl[3];     // cm/s^2
+    int16_t  gyro[3];     // CentiDegrees/s
     // Processed
-    int32_t  acclFilt;    // Really arbitrary units.
+    int32_t  acclFilt;    // Manhattan magnitude of accl, averaged. cm/s^2
 } imu_t;
 
-typedef struct {
+typedef struct __attribute__((packed)) {
     uint32_t time;        // ms from boot
     uint8_t  utc[3];      // Hours, minutes seconds
     int32_t  lon, lat;
     uint16_t sats;
 } gps_t;
 
-typedef struct {
+// Logged by the detector whenever the state changes
+typedef struct __attribute__((packed)) {
+    uint32_t time;        // ms from boot
+    uint8_t  state;       // enum states, the one just entered
+    uint32_t latency;     // us from the deciding sample arriving to here
+} event_t;
+
+// Logged by the estimator alongside the baro, see estimator.h
+typedef struct __attribute__((packed)) {
+    uint32_t time;        // ms from boot
+    int16_t  quat[4];     // Attitude, body to earth, Q14. w, x, y, z
+    int32_t  alt;         // cm above the pad
+    int16_t  vVel;        // dm/s, positive going up
+} est_t;
+
+// Calibration for a three axis sensor, applied by the sampler:
+// out = (I + scale / 2^CAL_SCALE_Q) * in - offset
+// where in is the raw reading already in the logged units. All zeros is no
+// correction, so blank and older configs just get the units.
+#define CAL_SCALE_Q 14
+
+typedef struct __attribute__((packed)) {
+    int16_t offset[3];    // Logged units
+    int16_t scale[3][3];  // Q(CAL_SCALE_Q), on top of identity
+} cal_t;
+
+// Configuration values written to flash. New fields only ever go on the
+// end, so a config saved by an older build still loads.
+typedef struct __attribute__((packed)) {
+    uint32_t glPres;      // Pressure at ground level
+    uint32_t mainPres;    // Pressure to deploy main at
+    // Flight profile. Sensor settings use the values from the driver enums.
+    uint8_t  profile;     // Which built in profile this started as
+    uint16_t i2cKhz;      // I2C bus speed
+    uint8_t  imuOdr;      // enum QMIAccelODR, also used for the gyro
+    uint8_t  compOdr;     // enum QMCODR
+    uint8_t  compOsr;     // enum QMCOSR
+    uint8_t  baroOsr;     // enum HP203_OSR
+    // Logging
+    uint8_t  ringLog;     // Overwrite the oldest log when full, see flash.h
+    // Per board calibration
+    cal_t    acclCal;
+    cal_t    gyroCal;
+    cal_t    compCal;
+} conf_t;
+
+// Header at the start of every sector of the log
+typedef struct __attribute__((packed)) {
+    uint32_t seq;         // Sectors written before this one
+    uint32_t time;        // ms from boot when the sector was started
+} sect_t;
+
+typedef struct __attribute__((packed)) {
     uint8_t marker;       // 0xAA
     uint8_t size;         // Bytes, not including header
     uint8_t type;
@@ -45,15 +103,13 @@ typedef struct {
         comp_t comp;
         imu_t  imu;
         gps_t  gps;
+        event_t event;
+        est_t  est;
+        conf_t conf;
+        sect_t sect;
     } data;
 } log_t;
 
-// Configuration values written to flash
-typedef struct {
-    uint32_t glPres;      // Pressure at ground level
-    uint32_t mainPres;    // Pressure to deploy main at
-} conf_t;
-
 enum states {
     BOOT           = 'b', // Sit here for some time, let the filters filter.
     GROUNDED       = 'g', // On the ground
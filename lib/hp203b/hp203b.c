@@ -1,5 +1,9 @@
 #include "hp203b.h"
 
+// Measurement times in us, indexed by channel + OSR
+static const uint32_t timeLookup[7] =
+{131100, 65600, 32800, 16400, 8200, 4100, 2100};
+
 /* Simple init function for HP203. */
 hp203_t HP203Init(i2c_inst_t *i2c)
 {
@@ -74,16 +78,31 @@ int8_t HP203Test(hp203_t *sensor)
     HP203_ERROR_GENERIC for other errors */
 int32_t HP203Measure(hp203_t *sensor, enum HP203_CHN channel, enum HP203_OSR OSR)
 {
-    static const uint32_t timeLookup[7] =
-    {131100, 65600, 32800, 16400, 8200, 4100, 2100};
+    int i2cState = HP203SendCommand(sensor, HP203MeasureCmd(channel, OSR));
+
+    return i2cState == 1 ? (int32_t) HP203MeasureTime(channel, OSR) : i2cState;
+}
 
-    uint8_t command = HP203_ADC_SET
-                      | OSR << HP203_OSR_SHIFT
-                      | channel;
+/* Returns the command byte that makes the HP203 start a measurement */
+uint8_t HP203MeasureCmd(enum HP203_CHN channel, enum HP203_OSR OSR)
+{
+    return HP203_ADC_SET
+           | OSR << HP203_OSR_SHIFT
+           | channel;
+}
 
-    int i2cState = HP203SendCommand(sensor, command);
+/* Returns the expected measurement time in us */
+uint32_t HP203MeasureTime(enum HP203_CHN channel, enum HP203_OSR OSR)
+{
+    return timeLookup[channel + OSR];
+}
 
-    return i2cState == 1 ? timeLookup[channel + OSR] : i2cState;
+/* Parses the 6 bytes read back after a HP203_READ_PT command */
+void HP203ParseData(const uint8_t *buffer, struct hp203_data *result)
+{
+    result->pres = buffer[5] | buffer[4] << 8 | buffer[3] << 16;
+    result->temp = buffer[2] | buffer[1] << 8 | buffer[0] << 16;
+    result->temp |= result->temp & 1 << 20 ? 0xFFF00000 : 0;
 }
 
 /*  Gets the pressure. Must be ran after a measurement has finished
@@ -150,9 +169,7 @@ int8_t HP203GetData(hp203_t *sensor, struct hp203_data *result)
 
     if(true)
     {
-        result->pres = buffer[5] | buffer[4] << 8 | buffer[3] << 16;
-        result->temp = buffer[2] | buffer[1] << 8 | buffer[0] << 16;
-        result->temp |= result->temp & 1 << 20 ? 0xFFF00000 : 0;
+        HP203ParseData(buffer, result);
     }
 
     // Return the worst bad error.
@@ -106,6 +106,18 @@ int8_t HP203GetPres(hp203_t *sensor, uint32_t *result);
     HP203_ERROR_GENERIC for other errors */
 int8_t HP203GetTemp(hp203_t *sensor, int32_t *result);
 
+/*  The following are for building transactions outside the driver, e.g.
+    with an asynchronous I2C queue. */
+
+/* Returns the command byte that makes the HP203 start a measurement */
+uint8_t HP203MeasureCmd(enum HP203_CHN channel, enum HP203_OSR OSR);
+
+/* Returns the expected measurement time in us */
+uint32_t HP203MeasureTime(enum HP203_CHN channel, enum HP203_OSR OSR);
+
+/* Parses the 6 bytes read back after a HP203_READ_PT command */
+void HP203ParseData(const uint8_t *buffer, struct hp203_data *result);
+
 /*  Gets pressure and temperature in a single i2c read.
     Returns:
     HP203_OK on success,
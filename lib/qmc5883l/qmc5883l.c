@@ -6,7 +6,7 @@ static int QMCWriteByte(qmc_t *sensor, enum QMCRegister reg, uint8_t value)
     uint8_t buffer[2];
     buffer[0] = reg;
     buffer[1] = value;
-    return i2c_write_timeout_per_char_us(sensor->i2c, QMC_ADDR, &buffer,
+    return i2c_write_timeout_per_char_us(sensor->i2c, QMC_ADDR, buffer,
                                          2, true, QMC_TIMEOUT);
 }
 
@@ -164,15 +164,22 @@ int8_t QMCGetMag(qmc_t *sensor, int16_t *data)
 
     if(i2cState == 6)
     {
-        data[0] = buffer[0] | (buffer[1] << 8);
-        data[1] = buffer[2] | (buffer[3] << 8);
-        data[2] = buffer[4] | (buffer[5] << 8);
+        QMCParseMag(buffer, data);
+        return QMC_OK;
     }
 
     return i2cState == QMC_ERROR_TIMEOUT ?
            QMC_ERROR_TIMEOUT : QMC_ERROR_GENERIC;
 }
 
+/*  Parses the 6 bytes read from QMC_XOUT_LSB onwards into data. */
+void QMCParseMag(const uint8_t *buffer, int16_t *data)
+{
+    data[0] = buffer[0] | (buffer[1] << 8);
+    data[1] = buffer[2] | (buffer[3] << 8);
+    data[2] = buffer[4] | (buffer[5] << 8);
+}
+
 /*  Reads temperature from the magnetometer and stores it in result
     Returns:
     QMC_OK if successful.
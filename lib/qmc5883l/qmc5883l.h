@@ -145,6 +145,10 @@ int8_t QMCGetCfg(qmc_t * sensor);
  * QMC_ERROR_GENERIC for other errors */
 int8_t QMCGetMag(qmc_t * sensor, int16_t * data);
 
+/* Parses the 6 bytes read from QMC_XOUT_LSB onwards into data.
+ * For building transactions outside the driver. */
+void QMCParseMag(const uint8_t * buffer, int16_t * data);
+
 /* Reads temperature from the magnetometer and stores it in result
  * Returns:
  * QMC_OK if successful.
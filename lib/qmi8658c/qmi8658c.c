@@ -1,5 +1,6 @@
 #include "qmi8658c.h"
 #include <math.h>
+#include <string.h>
 
 static int8_t QMIWriteByte(qmi_t *qmi, enum QMIRegister reg, uint8_t value)
 {
@@ -9,14 +10,39 @@ static int8_t QMIWriteByte(qmi_t *qmi, enum QMIRegister reg, uint8_t value)
     return 0;
 }
 
+/* Reads len bytes in a single repeated-start transfer. If auto-increment is
+ * on this reads consecutive registers. Also used to empty the FIFO, which
+ * hands over the next byte every time FIFO_DATA is read. */
+static int8_t QMIReadStream(qmi_t *qmi, enum QMIRegister reg, uint8_t *buffer, size_t len)
+{
+    uint8_t buf = reg;
+    int i2cState[2];
+
+    i2cState[0] = i2c_write_timeout_per_char_us(qmi->i2c, qmi->addr,
+                  &buf, 1, true, QMI_TIMEOUT);
+    i2cState[1] = i2c_read_timeout_per_char_us(qmi->i2c, qmi->addr,
+                  buffer, len, false, QMI_TIMEOUT);
+
+    if(i2cState[0] < 0 || i2cState[1] < 0)
+    {
+        return i2cState[0] < i2cState[1] ?
+               i2cState[0] : i2cState[1];
+    }
+
+    return QMI_OK;
+}
+
 static int8_t QMIReadBytes(qmi_t *qmi, enum QMIRegister reg, uint8_t *buffer, size_t len)
 {
     uint8_t buf = reg;
-    uint8_t i2cState[2];
+    int i2cState[2];
     uint32_t i;
 
+    if(qmi->autoInc)
+        return QMIReadStream(qmi, reg, buffer, len);
+
     // The QMI is supposed to autoincrement register pointers.
-    // It does not. :(
+    // It does not by default, so fall back to one register at a time.
     for(i = 0; i < len; i++)
     {
         i2cState[0] = i2c_write_timeout_per_char_us(qmi->i2c, qmi->addr,
@@ -26,7 +52,7 @@ static int8_t QMIReadBytes(qmi_t *qmi, enum QMIRegister reg, uint8_t *buffer, si
                       buffer + i, 1, false,
                       QMI_TIMEOUT);
 
-        if(i2cState[0] < 0 && i2cState[1] < 0)
+        if(i2cState[0] < 0 || i2cState[1] < 0)
         {
             return i2cState[0] < i2cState[1] ?
                    i2cState[0] : i2cState[1];
@@ -38,6 +64,23 @@ static int8_t QMIReadBytes(qmi_t *qmi, enum QMIRegister reg, uint8_t *buffer, si
     return 0;
 }
 
+/* Sends a host command through CTRL9 and waits for the QMI to finish it */
+static int8_t QMICommand(qmi_t *qmi, enum QMICommand cmd)
+{
+    uint8_t status = 0;
+    uint32_t i;
+
+    QMIWriteByte(qmi, QMI_CTRL_CMD, cmd);
+
+    for(i = 0; i < QMI_CMD_TRIES && !(status & QMI_CMD_DONE); i++)
+        QMIReadBytes(qmi, QMI_STATUSINT, &status, 1);
+
+    // The QMI wont take another command until this one is acknowledged
+    QMIWriteByte(qmi, QMI_CTRL_CMD, QMI_CMD_ACK);
+
+    return status & QMI_CMD_DONE ? QMI_OK : QMI_ERROR_TIMEOUT;
+}
+
 /*  Generates a QMI_T struct.
     SA0 is used to set the address, on Bob this should be set to false. */
 qmi_t QMIInit(i2c_inst_t *i2c, bool SA0)
@@ -45,9 +88,48 @@ qmi_t QMIInit(i2c_inst_t *i2c, bool SA0)
     qmi_t qmi;
     qmi.i2c = i2c;
     qmi.addr = QMI_ADDR | SA0;
+    qmi.fifoCtrl = QMI_FIFO_BYPASS;
+    qmi.autoInc = false;
     return qmi;
 }
 
+/*  Turns on address auto-increment (CTRL1 ADDR_AI), so multi-register reads
+    are done in one transfer rather than one per byte.
+    The first few registers are read both ways to check it actually works,
+    if they dont match the QMI is put back how it was.
+    Returns:
+    QMI_OK if burst reads are now in use.
+    QMI_ERROR_BAD_CONF if auto-increment doesnt work, and per-byte reads
+    are still in use.
+    QMI_ERROR_TIMEOUT if the I2C timesout.
+    QMI_ERROR_GENERIC for other errors. */
+int8_t QMIEnableBurst(qmi_t *qmi)
+{
+    uint8_t CTRL1;
+    uint8_t slow[3], fast[3];
+    int8_t i2cStatus;
+
+    qmi->autoInc = false;
+    i2cStatus = QMIReadBytes(qmi, QMI_CTRL1, &CTRL1, 1);
+    if(i2cStatus != QMI_OK)
+        return i2cStatus;
+
+    QMIWriteByte(qmi, QMI_CTRL1, CTRL1 | QMI_CTRL1_ADDR_AI);
+
+    // WHO_AM_I, REVISION_ID and CTRL1 wont change under us.
+    i2cStatus = QMIReadBytes(qmi, QMI_WHO_AM_I, slow, 3);
+    qmi->autoInc = true;
+    if(i2cStatus == QMI_OK)
+        i2cStatus = QMIReadBytes(qmi, QMI_WHO_AM_I, fast, 3);
+
+    if(i2cStatus == QMI_OK && memcmp(slow, fast, 3) == 0)
+        return QMI_OK;
+
+    qmi->autoInc = false;
+    QMIWriteByte(qmi, QMI_CTRL1, CTRL1);
+    return i2cStatus == QMI_OK ? QMI_ERROR_BAD_CONF : i2cStatus;
+}
+
 /*  The QMI has a self test system, but THEY HAVENT DOCUMENTED IT YET >:(
     Checks if the QMI talks and if the config is good. Returns:
 
@@ -177,6 +259,112 @@ int8_t QMIReadData(qmi_t *qmi, struct qmi_data *data)
     return i2cStatus;
 }
 
+/*  Configures the FIFO. The watermark is in samples.
+    Returns:
+    The value of FIFO_CTRL if successful.
+    QMI_ERROR_TIMEOUT if the I2C timesout or the FIFO doesnt reset.
+    QMI_ERROR_GENERIC for other errors */
+int8_t QMIFifoConfig(qmi_t *qmi, enum QMIFifoMode mode,
+                     enum QMIFifoSize size, uint8_t watermark)
+{
+    uint8_t buf = size << QMI_FIFO_SIZE_SHIFT | mode;
+    int8_t i2cStatus;
+
+    QMIWriteByte(qmi, QMI_FIFO_WTM_TH, watermark);
+    i2cStatus = QMIWriteByte(qmi, QMI_FIFO_CTRL, buf);
+
+    if(i2cStatus == QMI_OK)
+    {
+        qmi->fifoCtrl = buf;
+        i2cStatus = QMICommand(qmi, QMI_CMD_RST_FIFO);
+    }
+
+    return i2cStatus == QMI_OK ? buf : i2cStatus;
+}
+
+/*  Empties up to max frames out of the FIFO into data, oldest first.
+    Anything past max is left for the next read.
+    Returns:
+    The number of frames read if successful.
+    QMI_ERROR_TIMEOUT if the I2C timesout or the QMI doesnt hand over the FIFO.
+    QMI_ERROR_GENERIC for other errors */
+int16_t QMIFifoRead(qmi_t *qmi, struct qmi_data *data, uint16_t max,
+                    uint32_t *newest)
+{
+    uint8_t buf[QMI_FIFO_FRAME];
+    uint8_t count[2];
+    uint8_t ts[3];
+    uint32_t timestamp;
+    uint16_t queued, frames, i;
+    int8_t i2cStatus;
+
+    // Ask the QMI to let us at the FIFO. This sets FIFO_RD_MODE.
+    i2cStatus = QMICommand(qmi, QMI_CMD_REQ_FIFO);
+    if(i2cStatus != QMI_OK)
+        return i2cStatus;
+
+    i2cStatus = QMIReadBytes(qmi, QMI_FIFO_SMPL_CNT, count, 2);
+    if(i2cStatus == QMI_OK)
+        i2cStatus = QMIReadBytes(qmi, QMI_TIMESTAMP_LSB, ts, 3);
+
+    frames = 0;
+    if(i2cStatus == QMI_OK)
+    {
+        queued = QMIFifoFrames(count);
+        frames = MIN(queued, max);
+        timestamp = ts[0] | ts[1] << 8 | ts[2] << 16;
+        if(newest)
+            *newest = timestamp;
+    }
+
+    for(i = 0; i < frames && i2cStatus == QMI_OK; i++)
+    {
+        i2cStatus = QMIReadStream(qmi, QMI_FIFO_DATA, buf, QMI_FIFO_FRAME);
+
+        // The newest frame in the FIFO was sampled at the current
+        // timestamp, and frame i is queued - 1 - i before it.
+        QMIParseFifo(buf, 1, queued - i, timestamp, data + i);
+    }
+
+    // Hand the FIFO back, whatever happened.
+    QMIWriteByte(qmi, QMI_FIFO_CTRL, QMIFifoDone(qmi));
+
+    return i2cStatus == QMI_OK ? frames : i2cStatus;
+}
+
+/* Takes FIFO_SMPL_CNT and FIFO_STATUS and returns the number of frames */
+uint16_t QMIFifoFrames(const uint8_t *count)
+{
+    // The count is in 2 byte words
+    return ((count[1] & 0x03) << 8 | count[0]) * 2 / QMI_FIFO_FRAME;
+}
+
+/* Parses the oldest frames of the queued frames in the FIFO out of buf.
+   The newest queued frame was sampled at timestamp. */
+void QMIParseFifo(const uint8_t *buf, uint16_t frames, uint16_t queued,
+                  uint32_t timestamp, struct qmi_data *data)
+{
+    uint16_t i;
+
+    for(i = 0; i < frames; i++, buf += QMI_FIFO_FRAME)
+    {
+        data[i].timestamp = (timestamp - (queued - 1 - i)) & 0xFFFFFF;
+        data[i].temp = 0;
+        data[i].accel[0] = buf[0] | buf[1] << 8;
+        data[i].accel[1] = buf[2] | buf[3] << 8;
+        data[i].accel[2] = buf[4] | buf[5] << 8;
+        data[i].gyro[0] = buf[6] | buf[7] << 8;
+        data[i].gyro[1] = buf[8] | buf[9] << 8;
+        data[i].gyro[2] = buf[10] | buf[11] << 8;
+    }
+}
+
+/* Value to write to FIFO_CTRL to hand the FIFO back after reading it */
+uint8_t QMIFifoDone(qmi_t *qmi)
+{
+    return qmi->fifoCtrl & ~QMI_FIFO_RD_MODE;
+}
+
 /* Takes a raw accelerometer reading and returns a value in G */
 float QMIAccG(int16_t accel, enum QMIAccelScale scl)
 {
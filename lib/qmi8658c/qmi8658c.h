@@ -17,12 +17,20 @@ enum QMIRegister
     QMI_WHO_AM_I = 0x00,       // Should contain 0x05
 
     // Settings registers
+    QMI_CTRL1 = 0x02,          // Interface settings
     QMI_CTRL_ACC = 0x03,       // Accelerometer settings
     QMI_CTRL_GYRO = 0x04,      // Gyro settings
     QMI_CTRL_LPF = 0x06,       // Low pass filter settings
     QMI_CTRL_ENB = 0x08,       // Enable sensors
     QMI_CTRL_CMD = 0x0A,       // Host commands
 
+    // FIFO registers
+    QMI_FIFO_WTM_TH = 0x13,    // Watermark, in samples
+    QMI_FIFO_CTRL = 0x14,      // FIFO settings
+    QMI_FIFO_SMPL_CNT = 0x15,  // Bytes in the FIFO / 2, LSB
+    QMI_FIFO_STATUS = 0x16,    // FIFO flags, count MSB in bits 0-1
+    QMI_FIFO_DATA = 0x17,      // Read this repeatedly to empty the FIFO
+
     // Status registers
     QMI_STATUSINT = 0x2D,      // Sensor data availability
     QMI_STATUS0 = 0x2E,        // Output data overrun
@@ -56,6 +64,9 @@ enum QMIRegister
 
 #define QMI_SCALE_OFFSET 4
 
+// CTRL1 bits
+#define QMI_CTRL1_ADDR_AI (1 << 6) // Register address auto-increment
+
 enum QMIAccelScale
 {
     QMI_ACC_2G  = 0x00,
@@ -118,6 +129,38 @@ enum QMIOpt
     QMI_SYNC_SMPL   = 1 << 7
 };
 
+// Commands for the CTRL9 host command register
+enum QMICommand
+{
+    QMI_CMD_ACK      = 0x00,
+    QMI_CMD_RST_FIFO = 0x04,
+    QMI_CMD_REQ_FIFO = 0x05
+};
+
+#define QMI_CMD_DONE  (1 << 7) // CmdDone bit in STATUSINT
+#define QMI_CMD_TRIES 100      // How many times to poll for CmdDone
+
+enum QMIFifoMode
+{
+    QMI_FIFO_BYPASS = 0x00,    // FIFO disabled
+    QMI_FIFO_FIFO   = 0x01,    // Stops when full
+    QMI_FIFO_STREAM = 0x02     // Drops the oldest sample when full
+};
+
+enum QMIFifoSize
+{
+    QMI_FIFO_16  = 0x00,       // Samples per sensor
+    QMI_FIFO_32  = 0x01,
+    QMI_FIFO_64  = 0x02,
+    QMI_FIFO_128 = 0x03
+};
+
+#define QMI_FIFO_SIZE_SHIFT 2
+#define QMI_FIFO_RD_MODE    (1 << 7)
+
+// One FIFO frame is an accelerometer sample followed by a gyro sample
+#define QMI_FIFO_FRAME 12
+
 // Status codes
 enum QMIStatus
 {
@@ -137,6 +180,8 @@ typedef struct
 {
     i2c_inst_t *i2c;
     uint8_t addr;
+    uint8_t fifoCtrl;       // Last value written to FIFO_CTRL
+    bool autoInc;           // Use burst reads? See QMIEnableBurst
 } qmi_t;
 
 // The QMI really wants you to take big reads. Its kinda weird tbh.
@@ -152,6 +197,18 @@ struct qmi_data
     SA0 is used to set the address, on Bob this should be set to false. */
 qmi_t QMIInit(i2c_inst_t *i2c, bool SA0);
 
+/*  Turns on address auto-increment (CTRL1 ADDR_AI), so multi-register reads
+    are done in one transfer rather than one per byte.
+    The first few registers are read both ways to check it actually works,
+    if they dont match the QMI is put back how it was.
+    Returns:
+    QMI_OK if burst reads are now in use.
+    QMI_ERROR_BAD_CONF if auto-increment doesnt work, and per-byte reads
+    are still in use.
+    QMI_ERROR_TIMEOUT if the I2C timesout.
+    QMI_ERROR_GENERIC for other errors. */
+int8_t QMIEnableBurst(qmi_t *qmi);
+
 /*  The QMI has a self test system, but THEY HAVENT DOCUMENTED IT YET >:(
     Checks if the QMI talks and if the config is good. Returns:
 
@@ -201,6 +258,44 @@ int8_t QMIGyroConfig(qmi_t *qmi, enum QMIGyroODR odr, enum QMIGyroScale scl);
     QMI_ERROR_GENERIC for other errors */
 int8_t QMIReadData(qmi_t *qmi, struct qmi_data *data);
 
+/*  Configures the FIFO. The watermark is in samples.
+    Assumes both the accelerometer and gyro are enabled, as every frame
+    read back by QMIFifoRead is expected to hold one of each.
+    Returns:
+    The value of FIFO_CTRL if successful.
+    QMI_ERROR_TIMEOUT if the I2C timesout or the FIFO doesnt reset.
+    QMI_ERROR_GENERIC for other errors */
+int8_t QMIFifoConfig(qmi_t *qmi, enum QMIFifoMode mode,
+                     enum QMIFifoSize size, uint8_t watermark);
+
+/*  Empties up to max frames out of the FIFO into data, oldest first.
+    The QMI's timestamp is a sample counter, so each frame is given the
+    counter value it was sampled at, working back from the newest frame in
+    the FIFO. Anything past max is left for the next read. The newest
+    frame's counter value is put in newest, if its not NULL.
+    Temperature isnt stored in the FIFO and is left at 0.
+    Returns:
+    The number of frames read if successful.
+    QMI_ERROR_TIMEOUT if the I2C timesout or the QMI doesnt hand over the FIFO.
+    QMI_ERROR_GENERIC for other errors */
+int16_t QMIFifoRead(qmi_t *qmi, struct qmi_data *data, uint16_t max,
+                    uint32_t *newest);
+
+/*  The following are for building FIFO reads outside the driver, e.g.
+    with an asynchronous I2C queue. See QMIFifoRead for the sequence. */
+
+/* Takes FIFO_SMPL_CNT and FIFO_STATUS and returns the number of frames */
+uint16_t QMIFifoFrames(const uint8_t *count);
+
+/* Parses the oldest frames of the queued frames in the FIFO out of buf.
+   The newest queued frame, which may not be in buf, was sampled at
+   timestamp. */
+void QMIParseFifo(const uint8_t *buf, uint16_t frames, uint16_t queued,
+                  uint32_t timestamp, struct qmi_data *data);
+
+/* Value to write to FIFO_CTRL to hand the FIFO back after reading it */
+uint8_t QMIFifoDone(qmi_t *qmi);
+
 /* Takes a raw reading from the gyro and returns a value in dps */
 float QMIGyroDPS(int16_t gyro, enum QMIGyroScale scl);
 
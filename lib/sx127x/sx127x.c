@@ -0,0 +1,256 @@
+#include "sx127x.h"
+
+#define SX_XTAL 32000000
+
+// RSSI offsets for the low (169 - 525 MHz) and high frequency ports
+#define SX_RSSI_LF   164
+#define SX_RSSI_HF   157
+#define SX_HF_CUTOFF 525000000
+
+// Bandwidths in Hz, indexed by enum SX_BW
+static const uint32_t bwLookup[10] =
+{7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000};
+
+/* Simple init function for the radio. The SPI bus and its pins must
+   already be set up. */
+sx127x_t SXInit(spi_inst_t *spi, uint cs, uint reset)
+{
+    sx127x_t radio;
+    radio.spi = spi;
+    radio.cs = cs;
+    radio.reset = reset;
+    radio.freq = 0;
+    return radio;
+}
+
+/* Reads a register */
+uint8_t SXReadReg(sx127x_t *radio, uint8_t reg)
+{
+    uint8_t tx[2] = {reg & ~SX_WRITE, 0};
+    uint8_t rx[2];
+
+    gpio_put(radio->cs, 0);
+    spi_write_read_blocking(radio->spi, tx, rx, 2);
+    gpio_put(radio->cs, 1);
+
+    return rx[1];
+}
+
+/* Writes a register */
+void SXWriteReg(sx127x_t *radio, uint8_t reg, uint8_t value)
+{
+    uint8_t tx[2] = {reg | SX_WRITE, value};
+
+    gpio_put(radio->cs, 0);
+    spi_write_blocking(radio->spi, tx, 2);
+    gpio_put(radio->cs, 1);
+}
+
+/*  Resets the radio and puts it in LoRa standby at freq Hz, with CRCs on,
+    17 dBm out of PA_BOOST, and SF7, 125 kHz, 4/5.
+    Returns:
+    SX_OK on success
+    SX_ERROR_BADCHIP if theres no radio, or it isnt an SX127x
+
+    Function takes approximately 20 ms to run. */
+int8_t SXBegin(sx127x_t *radio, uint32_t freq)
+{
+    gpio_init(radio->cs);
+    gpio_set_dir(radio->cs, GPIO_OUT);
+    gpio_put(radio->cs, 1);
+
+    gpio_init(radio->reset);
+    gpio_set_dir(radio->reset, GPIO_OUT);
+    gpio_put(radio->reset, 0);
+    sleep_ms(10);
+    gpio_put(radio->reset, 1);
+    sleep_ms(10);
+
+    if(SXReadReg(radio, SX_REG_VERSION) != SX_VERSION)
+        return SX_ERROR_BADCHIP;
+
+    // LoRa mode can only be switched to from sleep
+    SXSetMode(radio, SX_MODE_SLEEP);
+    SXSetFrequency(radio, freq);
+
+    // The whole FIFO is ours for either direction
+    SXWriteReg(radio, SX_REG_FIFO_TX_BASE, 0);
+    SXWriteReg(radio, SX_REG_FIFO_RX_BASE, 0);
+
+    // LNA boost
+    SXWriteReg(radio, SX_REG_LNA, SXReadReg(radio, SX_REG_LNA) | 0x03);
+
+    SXSetModem(radio, 7, SX_BW_125K, 5);
+    SXSetTxPower(radio, 17);
+    SXSetMode(radio, SX_MODE_STDBY);
+
+    return SX_OK;
+}
+
+/* Changes mode. mode is one of SX_MODE_*, without SX_MODE_LORA */
+void SXSetMode(sx127x_t *radio, uint8_t mode)
+{
+    SXWriteReg(radio, SX_REG_OP_MODE, SX_MODE_LORA | mode);
+}
+
+/* Sets the frequency in Hz */
+void SXSetFrequency(sx127x_t *radio, uint32_t freq)
+{
+    uint32_t frf = ((uint64_t) freq << 19) / SX_XTAL;
+
+    radio->freq = freq;
+    SXWriteReg(radio, SX_REG_FRF_MSB, frf >> 16);
+    SXWriteReg(radio, SX_REG_FRF_MID, frf >> 8);
+    SXWriteReg(radio, SX_REG_FRF_LSB, frf);
+}
+
+/* Sets the spreading factor (6 - 12), bandwidth and coding rate
+   denominator (5 - 8). Must be in standby or sleep. */
+void SXSetModem(sx127x_t *radio, uint8_t sf, enum SX_BW bw, uint8_t cr)
+{
+    uint32_t symUs;
+
+    sf = MIN(MAX(sf, 6), 12);
+    cr = MIN(MAX(cr, 5), 8);
+
+    // SF6 only works with an implicit header, and needs its own detection
+    // settings. Pick something else if you want to use explicit headers.
+    SXWriteReg(radio, SX_REG_DETECT_OPTIMIZE, sf == 6 ? 0xC5 : 0xC3);
+    SXWriteReg(radio, SX_REG_DETECT_THRESHOLD, sf == 6 ? 0x0C : 0x0A);
+
+    // Bandwidth, coding rate, explicit header
+    SXWriteReg(radio, SX_REG_MODEM_CONFIG_1, bw << 4 | (cr - 4) << 1);
+    // Spreading factor, CRC on
+    SXWriteReg(radio, SX_REG_MODEM_CONFIG_2, sf << 4 | 0x04);
+
+    // Low data rate optimisation is needed once a symbol is over 16 ms.
+    // Auto AGC.
+    symUs = (1000000u << sf) / bwLookup[bw];
+    SXWriteReg(radio, SX_REG_MODEM_CONFIG_3, (symUs > 16000 ? 0x08 : 0) | 0x04);
+}
+
+/* Sets the output power out of PA_BOOST, 2 - 20 dBm */
+void SXSetTxPower(sx127x_t *radio, int8_t dBm)
+{
+    dBm = MIN(MAX(dBm, 2), 20);
+
+    if(dBm > 17) {
+        // +20 dBm mode, see section 5.4.3 of the datasheet. 18 - 20 map
+        // onto 15 - 17.
+        SXWriteReg(radio, SX_REG_PA_DAC, 0x87);
+        SXWriteReg(radio, SX_REG_OCP, 0x20 | ((140 + 30) / 10));
+        dBm -= 3;
+    } else {
+        SXWriteReg(radio, SX_REG_PA_DAC, 0x84);
+        SXWriteReg(radio, SX_REG_OCP, 0x20 | ((100 - 45) / 5));
+    }
+
+    SXWriteReg(radio, SX_REG_PA_CONFIG, 0x80 | (dBm - 2));
+}
+
+/* Gets the IRQ flags */
+uint8_t SXIrqFlags(sx127x_t *radio)
+{
+    return SXReadReg(radio, SX_REG_IRQ_FLAGS);
+}
+
+/* Clears IRQ flags */
+void SXClearIrq(sx127x_t *radio, uint8_t flags)
+{
+    SXWriteReg(radio, SX_REG_IRQ_FLAGS, flags);
+}
+
+/* Starts a burst write of len bytes into the FIFO. Send exactly len bytes
+   down the SPI bus, then call SXFifoEnd. Must be in standby. */
+void SXFifoBegin(sx127x_t *radio, uint8_t len)
+{
+    uint8_t cmd = SX_REG_FIFO | SX_WRITE;
+
+    SXWriteReg(radio, SX_REG_FIFO_ADDR_PTR, 0);
+    SXWriteReg(radio, SX_REG_PAYLOAD_LENGTH, len);
+
+    // The FIFO address auto-increments for as long as CS stays low
+    gpio_put(radio->cs, 0);
+    spi_write_blocking(radio->spi, &cmd, 1);
+}
+
+/* Finishes a burst started with SXFifoBegin, once the bytes are sent */
+void SXFifoEnd(sx127x_t *radio)
+{
+    spi_hw_t *hw = spi_get_hw(radio->spi);
+
+    // Let the last byte get out, then throw away what came back
+    while(spi_is_busy(radio->spi))
+        tight_loop_contents();
+    while(spi_is_readable(radio->spi))
+        (void) hw->dr;
+    hw->icr = SPI_SSPICR_RORIC_BITS;
+
+    gpio_put(radio->cs, 1);
+}
+
+/* Writes a packet into the FIFO in one burst, ready for SX_MODE_TX.
+   Must be in standby. */
+void SXWriteFifo(sx127x_t *radio, const uint8_t *buf, uint8_t len)
+{
+    SXFifoBegin(radio, len);
+    spi_write_blocking(radio->spi, buf, len);
+    SXFifoEnd(radio);
+}
+
+/* Maps DIO0 to RX done and starts listening continuously */
+void SXReceive(sx127x_t *radio)
+{
+    SXWriteReg(radio, SX_REG_DIO_MAPPING_1, SX_DIO0_RXDONE);
+    SXWriteReg(radio, SX_REG_FIFO_ADDR_PTR, 0);
+    SXSetMode(radio, SX_MODE_RXCONT);
+}
+
+/*  Reads the last packet received into buf, up to max bytes.
+    Returns the length of the packet, which may be more than max. */
+uint8_t SXReadPacket(sx127x_t *radio, uint8_t *buf, uint8_t max)
+{
+    uint8_t len = SXReadReg(radio, SX_REG_RX_NB_BYTES);
+    uint8_t cmd = SX_REG_FIFO;
+
+    SXWriteReg(radio, SX_REG_FIFO_ADDR_PTR,
+               SXReadReg(radio, SX_REG_FIFO_RX_CURRENT));
+
+    gpio_put(radio->cs, 0);
+    spi_write_blocking(radio->spi, &cmd, 1);
+    spi_read_blocking(radio->spi, 0, buf, MIN(len, max));
+    gpio_put(radio->cs, 1);
+
+    return len;
+}
+
+/* Returns the RSSI of the last packet received in dBm */
+int16_t SXPacketRssi(sx127x_t *radio)
+{
+    return SXReadReg(radio, SX_REG_PKT_RSSI)
+         - (radio->freq < SX_HF_CUTOFF ? SX_RSSI_LF : SX_RSSI_HF);
+}
+
+/* Returns the SNR of the last packet received in quarter dB */
+int8_t SXPacketSnr(sx127x_t *radio)
+{
+    return (int8_t) SXReadReg(radio, SX_REG_PKT_SNR);
+}
+
+/* Returns how long a packet of len bytes is on air for in us, with an
+   explicit header and a CRC. See Semtech's AN1200.13. */
+uint32_t SXAirtimeUs(uint8_t sf, enum SX_BW bw, uint8_t cr, uint8_t len)
+{
+    uint32_t symUs = (1000000u << sf) / bwLookup[bw];
+    int32_t de = symUs > 16000 ? 1 : 0;
+    int32_t num = 8 * len - 4 * sf + 28 + 16;
+    int32_t den = 4 * (sf - 2 * de);
+    int32_t symbols = 8;
+
+    // Round the payload symbols up to a whole number of codewords
+    if(num > 0)
+        symbols += (num + den - 1) / den * cr;
+
+    // The preamble has 4.25 symbols on top
+    return (SX_PREAMBLE * 4 + 17) * symUs / 4 + symbols * symUs;
+}
@@ -0,0 +1,164 @@
+/*  Small driver for the SX1276/7/8/9 LoRa radios, in LoRa mode only.
+    A sx127x struct can be created using SXInit, then the radio is reset
+    and set up with SXBegin.
+
+    Register map and setup follow lib/pico-lora, but the FIFO is written
+    in one burst, and nothing here waits for the radio to finish sending.
+    Map DIO0 to TX done (or RX done) and watch it for that instead.
+
+    SXFifoBegin and SXFifoEnd let the payload be streamed in by something
+    else, e.g. DMA. Nothing else may use the SPI bus in between. */
+
+#ifndef SX127X_H
+#define SX127X_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+
+#define SX_VERSION      0x12
+#define SX_MAX_PAYLOAD  255
+#define SX_PREAMBLE     8       // Symbols, the reset value
+
+// Registers
+#define SX_REG_FIFO             0x00
+#define SX_REG_OP_MODE          0x01
+#define SX_REG_FRF_MSB          0x06
+#define SX_REG_FRF_MID          0x07
+#define SX_REG_FRF_LSB          0x08
+#define SX_REG_PA_CONFIG        0x09
+#define SX_REG_OCP              0x0B
+#define SX_REG_LNA              0x0C
+#define SX_REG_FIFO_ADDR_PTR    0x0D
+#define SX_REG_FIFO_TX_BASE     0x0E
+#define SX_REG_FIFO_RX_BASE     0x0F
+#define SX_REG_FIFO_RX_CURRENT  0x10
+#define SX_REG_IRQ_FLAGS        0x12
+#define SX_REG_RX_NB_BYTES      0x13
+#define SX_REG_PKT_SNR          0x19
+#define SX_REG_PKT_RSSI         0x1A
+#define SX_REG_MODEM_CONFIG_1   0x1D
+#define SX_REG_MODEM_CONFIG_2   0x1E
+#define SX_REG_PAYLOAD_LENGTH   0x22
+#define SX_REG_MODEM_CONFIG_3   0x26
+#define SX_REG_DETECT_OPTIMIZE  0x31
+#define SX_REG_DETECT_THRESHOLD 0x37
+#define SX_REG_SYNC_WORD        0x39
+#define SX_REG_DIO_MAPPING_1    0x40
+#define SX_REG_VERSION          0x42
+#define SX_REG_PA_DAC           0x4D
+
+#define SX_WRITE 0x80
+
+// Operating modes, all in LoRa mode
+#define SX_MODE_LORA    0x80
+#define SX_MODE_SLEEP   0x00
+#define SX_MODE_STDBY   0x01
+#define SX_MODE_TX      0x03
+#define SX_MODE_RXCONT  0x05
+
+// IRQ flags
+#define SX_IRQ_TX_DONE  0x08
+#define SX_IRQ_CRC_ERR  0x20
+#define SX_IRQ_RX_DONE  0x40
+
+// DIO0 mappings
+#define SX_DIO0_RXDONE  0x00
+#define SX_DIO0_TXDONE  0x40
+
+// Error codes
+#define SX_OK             0
+#define SX_ERROR_BADCHIP -3
+
+// Values for the bandwidth bits of REG_MODEM_CONFIG_1
+enum SX_BW
+{
+    SX_BW_7K8   = 0,
+    SX_BW_10K4  = 1,
+    SX_BW_15K6  = 2,
+    SX_BW_20K8  = 3,
+    SX_BW_31K25 = 4,
+    SX_BW_41K7  = 5,
+    SX_BW_62K5  = 6,
+    SX_BW_125K  = 7,
+    SX_BW_250K  = 8,
+    SX_BW_500K  = 9
+};
+
+typedef struct
+{
+    spi_inst_t *spi;
+    uint cs;
+    uint reset;
+    uint32_t freq;
+} sx127x_t;
+
+/* Simple init function for the radio. The SPI bus and its pins must
+   already be set up. */
+sx127x_t SXInit(spi_inst_t *spi, uint cs, uint reset);
+
+/*  Resets the radio and puts it in LoRa standby at freq Hz, with CRCs on,
+    17 dBm out of PA_BOOST, and SF7, 125 kHz, 4/5.
+    Returns:
+    SX_OK on success
+    SX_ERROR_BADCHIP if theres no radio, or it isnt an SX127x
+
+    Function takes approximately 20 ms to run. */
+int8_t SXBegin(sx127x_t *radio, uint32_t freq);
+
+/* Reads a register */
+uint8_t SXReadReg(sx127x_t *radio, uint8_t reg);
+
+/* Writes a register */
+void SXWriteReg(sx127x_t *radio, uint8_t reg, uint8_t value);
+
+/* Changes mode. mode is one of SX_MODE_*, without SX_MODE_LORA */
+void SXSetMode(sx127x_t *radio, uint8_t mode);
+
+/* Sets the frequency in Hz */
+void SXSetFrequency(sx127x_t *radio, uint32_t freq);
+
+/* Sets the spreading factor (6 - 12), bandwidth and coding rate
+   denominator (5 - 8). Must be in standby or sleep. */
+void SXSetModem(sx127x_t *radio, uint8_t sf, enum SX_BW bw, uint8_t cr);
+
+/* Sets the output power out of PA_BOOST, 2 - 20 dBm */
+void SXSetTxPower(sx127x_t *radio, int8_t dBm);
+
+/* Gets the IRQ flags */
+uint8_t SXIrqFlags(sx127x_t *radio);
+
+/* Clears IRQ flags */
+void SXClearIrq(sx127x_t *radio, uint8_t flags);
+
+/* Writes a packet into the FIFO in one burst, ready for SX_MODE_TX.
+   Must be in standby. */
+void SXWriteFifo(sx127x_t *radio, const uint8_t *buf, uint8_t len);
+
+/* Starts a burst write of len bytes into the FIFO. Send exactly len bytes
+   down the SPI bus, then call SXFifoEnd. Must be in standby. */
+void SXFifoBegin(sx127x_t *radio, uint8_t len);
+
+/* Finishes a burst started with SXFifoBegin, once the bytes are sent */
+void SXFifoEnd(sx127x_t *radio);
+
+/* Maps DIO0 to RX done and starts listening continuously */
+void SXReceive(sx127x_t *radio);
+
+/*  Reads the last packet received into buf, up to max bytes.
+    Returns the length of the packet, which may be more than max. */
+uint8_t SXReadPacket(sx127x_t *radio, uint8_t *buf, uint8_t max);
+
+/* Returns the RSSI of the last packet received in dBm */
+int16_t SXPacketRssi(sx127x_t *radio);
+
+/* Returns the SNR of the last packet received in quarter dB */
+int8_t SXPacketSnr(sx127x_t *radio);
+
+/* Returns how long a packet of len bytes is on air for in us, with an
+   explicit header and a CRC. See Semtech's AN1200.13. */
+uint32_t SXAirtimeUs(uint8_t sf, enum SX_BW bw, uint8_t cr, uint8_t len);
+
+#endif
@@ -0,0 +1,204 @@
+#include "bench.h"
+#include "filter.h"
+#include "flash.h"
+#include "sampler.h"
+#include "taskList.h"
+
+#include <pico/stdlib.h>
+#include <hardware/clocks.h>
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+#include <string.h>
+
+// The scratch block, right under the config. Only used if the program
+// doesnt reach it.
+#define BENCH_SIZE FLASH_BLOCK_SIZE
+#define BENCH_ADR  (F_PROG_SIZE - BENCH_SIZE)
+
+// Externs
+extern taskList_t tl;
+
+// End of the program image, from the SDK's linker script
+extern char __flash_binary_end;
+
+typedef struct {
+    char     op;
+    uint32_t len;
+    uint32_t offs;
+} benchCase_t;
+
+/* Programs first, then erases, so each erase has data to clear. The last
+ * case leaves the scratch erased. */
+static const benchCase_t cases[BENCH_CASES] = {
+    {'p', FLASH_PAGE_SIZE, 0},                        // A page, like fTask
+    {'p', 4 * FLASH_PAGE_SIZE, 0},
+    {'p', 4 * FLASH_PAGE_SIZE, 2 * FLASH_PAGE_SIZE},  // Some cross sectors
+    {'p', FLASH_SECTOR_SIZE, 0},
+    {'e', FLASH_SECTOR_SIZE, 0},                      // Like the log
+    {'e', FLASH_BLOCK_SIZE, 0}                        // One block erase
+};
+
+static bench_t results[BENCH_CASES];
+
+static int8_t   current = -1;      // Case being run, -1 if not running
+static uint32_t at;                // Offset into the scratch of the next call
+static uint32_t prepAdr;           // Offset of the next sector to prepare
+static uint32_t missedStart;       // sensorMissed when the case started
+static bool     dirty = true;      // Has the scratch been programmed?
+
+// What gets programmed. Has to be in RAM, as the flash is off limits.
+static uint8_t pattern[FLASH_SECTOR_SIZE];
+
+// Filters shaped like the sampler's baro speed and acclFilt
+static const biquad_t benchBiquad = {.b = {160, 0, -160}, .a = {-112, 49},
+                                     .shift = 8};
+#define BENCH_MA_SHIFT 3
+
+// Keeps the compiler from throwing the filtering away
+static volatile int32_t benchSink;
+
+/* ---------------------- HELPERS ----------------------- */
+
+/* Gets case n going. Programs need the scratch blank and erases need
+ * something to erase, so it may need preparing first. */
+static void benchCase(int8_t n) {
+    const benchCase_t * c = &cases[n];
+
+    current = n;
+    at = c->offs;
+    prepAdr = dirty == (c->op == 'e') ? BENCH_SIZE : 0;
+
+    results[n].op = c->op;
+    results[n].len = c->len;
+    results[n].offs = c->offs;
+}
+
+/* ----------------------- TASKS ------------------------ */
+
+/* Does one call of the current case, or a sector of preparation for it */
+static void benchTask(void * data) {
+    const benchCase_t * c = &cases[current];
+    bench_t * r = &results[current];
+    uint32_t period, start, us;
+    int ints;
+
+    // Preparation isnt timed
+    if(prepAdr < BENCH_SIZE) {
+        ints = fLock();
+        if(c->op == 'e')
+            flash_range_program(BENCH_ADR + prepAdr, pattern, FLASH_SECTOR_SIZE);
+        else
+            flash_range_erase(BENCH_ADR + prepAdr, FLASH_SECTOR_SIZE);
+        fUnlock(ints);
+
+        prepAdr += FLASH_SECTOR_SIZE;
+        dirty = c->op == 'e';
+        tlAddPrio(&tl, TL_LOW, benchTask, NULL);
+        return;
+    }
+
+    if(at == c->offs)
+        missedStart = sensorMissed(&period);
+
+    start = time_us_32();
+    ints = fLock();
+    if(c->op == 'p')
+        flash_range_program(BENCH_ADR + at, pattern, c->len);
+    else
+        flash_range_erase(BENCH_ADR + at, c->len);
+    us = time_us_32() - start;
+    fUnlock(ints);
+
+    if(!r->calls || us < r->minUs)
+        r->minUs = us;
+    if(us > r->maxUs)
+        r->maxUs = us;
+    r->totalUs += us;
+    r->calls++;
+    at += c->len;
+    dirty = c->op == 'p';
+
+    if(at + c->len <= BENCH_SIZE) {
+        tlAddPrio(&tl, TL_LOW, benchTask, NULL);
+        return;
+    }
+
+    // Case done. A late tick is counted as soon as interrupts are back on.
+    r->missed = sensorMissed(&period) - missedStart;
+    if(current + 1 < BENCH_CASES) {
+        benchCase(current + 1);
+        tlAddPrio(&tl, TL_LOW, benchTask, NULL);
+    } else {
+        current = -1;
+    }
+}
+
+/* ------------------ PUBLIC FUNCTIONS ------------------ */
+
+/* Starts the benchmark in the background, on the main task list.
+ * Returns 0 on success, 1 if the program runs into the scratch block, 2 if
+ * its already running. */
+uint8_t benchStart(void) {
+    uint32_t i;
+
+    if((uintptr_t) &__flash_binary_end > XIP_BASE + BENCH_ADR)
+        return 1;
+    if(current >= 0)
+        return 2;
+
+    // Anything but 0xFF, so every byte really gets programmed
+    for(i = 0; i < sizeof(pattern); i++)
+        pattern[i] = i % 0xFF;
+    memset(results, 0, sizeof(results));
+
+    benchCase(0);
+    tlAddPrio(&tl, TL_LOW, benchTask, NULL);
+    return 0;
+}
+
+/* Returns how far through the benchmark we are, in percent. 100 if it
+ * isnt running. */
+int benchProgress(void) {
+    return current < 0 ? 100 : current * 100 / BENCH_CASES;
+}
+
+/* Copies the results of case n into out.
+ * Returns 0 on success, 1 if theres no such case. */
+int benchGet(int n, bench_t * out) {
+    if(n < 0 || n >= BENCH_CASES)
+        return 1;
+
+    *out = results[n];
+    return 0;
+}
+
+/* Times the filters, with interrupts off so only they are counted */
+void benchFilters(uint32_t * biquadCyc, uint32_t * maCyc) {
+    biquadState_t st;
+    movAvg_t ma;
+    int32_t maBuf[1 << BENCH_MA_SHIFT];
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+    uint32_t ints, start, biquadUs, maUs;
+    int32_t y = 0;
+    int i;
+
+    biquadReset(&st);
+    maInit(&ma, maBuf, BENCH_MA_SHIFT);
+
+    ints = save_and_disable_interrupts();
+    start = time_us_32();
+    for(i = 0; i < BENCH_FILTER_STEPS; i++)
+        y += biquadStep(&benchBiquad, &st, 100000 + (i & 1023));
+    biquadUs = time_us_32() - start;
+
+    start = time_us_32();
+    for(i = 0; i < BENCH_FILTER_STEPS; i++)
+        y += maStep(&ma, 981 + (i & 1023));
+    maUs = time_us_32() - start;
+    restore_interrupts(ints);
+
+    benchSink = y;
+    *biquadCyc = biquadUs * mhz / BENCH_FILTER_STEPS;
+    *maCyc = maUs * mhz / BENCH_FILTER_STEPS;
+}
@@ -0,0 +1,35 @@
+#include "calib.h"
+
+#include <pico/stdlib.h>
+
+/* ------------------ PUBLIC FUNCTIONS ------------------ */
+
+/* Builds the table for a sensor from its calibration and its units.
+ * units is under 2^12 and the matrix entries under 2^15, so every product
+ * here stays under 2^31. */
+void calBuild(calTable_t * t, const cal_t * cal, int32_t units) {
+    int i, j;
+
+    for(i = 0; i < 3; i++) {
+        for(j = 0; j < 3; j++) {
+            int32_t m = cal->scale[i][j] + (i == j ? 1 << CAL_SCALE_Q : 0);
+            t->k[i][j] = (units * m) >> CAL_SCALE_Q;
+        }
+        t->offset[i] = cal->offset[i];
+    }
+}
+
+/* Turns a raw reading into calibrated, real units. Saturates at int16.
+ * Each row sums three products of a count (under 2^15) and a table entry
+ * (under 2^14). */
+void calApply(const calTable_t * t, const int16_t raw[3], int16_t out[3]) {
+    int32_t v;
+    int i;
+
+    for(i = 0; i < 3; i++) {
+        v = (t->k[i][0] * raw[0] + t->k[i][1] * raw[1] + t->k[i][2] * raw[2]
+             + (1 << (CAL_Q - 1))) >> CAL_Q;
+        v -= t->offset[i];
+        out[i] = MIN(MAX(v, INT16_MIN), INT16_MAX);
+    }
+}
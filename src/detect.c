@@ -0,0 +1,177 @@
+#include "detect.h"
+#include "filter.h"
+#include "flash.h"
+
+#include <pico/stdlib.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Helper functions
+#define NOW_US time_us_32()
+
+// How long do we wait for the filters to filter
+#define BOOT_TIME_MS 1000
+
+// Launch is called once acclFilt has stayed over LAUNCH_ACCL for LAUNCH_MS.
+// The manhattan magnitude can read up to 1.7 g sat still, so 3 g is well
+// clear of the pad.
+#define LAUNCH_ACCL (3 * G_CMSS)
+#define LAUNCH_MS   30
+
+// Burnout once acclFilt has stayed under BURNOUT_ACCL for BURNOUT_MS. Drag
+// keeps it off zero for a while after, so this sits above 1 g.
+#define BURNOUT_ACCL (2 * G_CMSS)
+#define BURNOUT_MS   50
+
+// Apogee once vVel has been up to or past 0 for this many samples in a row
+#define APOGEE_SAMPLES 2
+
+// Main once the pressure has been over mainPres for this many in a row
+#define MAIN_SAMPLES 2
+
+// Landed once the average of the last 2^LANDED_AVG vVels has stayed within
+// LANDED_VVEL of 0 for LANDED_MS
+#define LANDED_AVG  4
+#define LANDED_VVEL 2
+#define LANDED_MS   5000
+
+// Externs
+extern enum states state;
+
+static uint32_t mainPres;
+
+// Progress through the current state. All times are sample times in ms.
+static uint32_t since;        // When the state was entered
+static bool     held;         // Is the condition being held right now?
+static uint32_t heldSince;    // and since when
+static uint8_t  count;        // Samples in a row that met the condition
+
+// vVel averaged for landing
+static movAvg_t velAvg;
+static int32_t velBuf[1 << LANDED_AVG];
+
+// Worst latency from each sensor, in us
+static uint32_t imuWorst, baroWorst;
+
+/* ---------------------- HELPERS ----------------------- */
+
+/* Moves to a new state and logs the change */
+static void detectSet(enum states s, uint32_t time, uint32_t arrivalUs) {
+    event_t ev;
+
+    state = s;
+    since = time;
+    held = false;
+    count = 0;
+
+    ev.time = time;
+    ev.state = s;
+    ev.latency = NOW_US - arrivalUs;
+    fPush(&ev, sizeof(event_t), EVENT);
+}
+
+/* Returns true once cond has been true for ms in a row */
+static bool detectHeld(bool cond, uint32_t time, uint32_t ms) {
+    if(!cond) {
+        held = false;
+        return false;
+    }
+
+    if(!held) {
+        held = true;
+        heldSince = time;
+    }
+    return time - heldSince >= ms;
+}
+
+/* Keeps track of the worst latency */
+static void detectWorst(uint32_t * worst, uint32_t arrivalUs) {
+    uint32_t lat = NOW_US - arrivalUs;
+
+    if(lat > *worst)
+        *worst = lat;
+}
+
+/* ------------------ PUBLIC FUNCTIONS ------------------ */
+
+/* Starts detection again from BOOT, using the deployment settings in cfg */
+void detectInit(const conf_t * cfg) {
+    state = BOOT;
+    mainPres = cfg->mainPres;
+    since = 0;
+    held = false;
+    count = 0;
+    imuWorst = 0;
+    baroWorst = 0;
+    maInit(&velAvg, velBuf, LANDED_AVG);
+}
+
+/* Runs detection on a processed IMU sample. Launch, burnout and the fire
+ * timers run off the IMU, as it is the fastest sensor. */
+void detectImu(const imu_t * imu, uint32_t arrivalUs) {
+    switch(state) {
+    case BOOT:
+        if(imu->time >= BOOT_TIME_MS)
+            detectSet(GROUNDED, imu->time, arrivalUs);
+        break;
+    case GROUNDED:
+        if(detectHeld(imu->acclFilt >= LAUNCH_ACCL, imu->time, LAUNCH_MS))
+            detectSet(BOOST, imu->time, arrivalUs);
+        break;
+    case BOOST:
+        if(detectHeld(imu->acclFilt < BURNOUT_ACCL, imu->time, BURNOUT_MS))
+            detectSet(COAST, imu->time, arrivalUs);
+        break;
+    case DROGUE_FIRE:
+        if(imu->time - since >= DETECT_FIRE_MS)
+            detectSet(DROGUE_OUT, imu->time, arrivalUs);
+        break;
+    case MAIN_FIRE:
+        if(imu->time - since >= DETECT_FIRE_MS)
+            detectSet(MAIN_OUT, imu->time, arrivalUs);
+        break;
+    default:
+        break;
+    }
+
+    detectWorst(&imuWorst, arrivalUs);
+}
+
+/* Runs detection on a processed baro sample. Apogee, main and landing run
+ * off the baro. */
+void detectBaro(const baro_t * baro, uint32_t arrivalUs) {
+    int32_t vel = maStep(&velAvg, baro->vVel);
+
+    switch(state) {
+    case COAST:
+        // vVel is negative going up
+        count = baro->vVel >= 0 ? count + 1 : 0;
+        if(count >= APOGEE_SAMPLES)
+            detectSet(DROGUE_FIRE, baro->time, arrivalUs);
+        break;
+    case DROGUE_OUT:
+        if(mainPres) {
+            count = baro->pres >= mainPres ? count + 1 : 0;
+            if(count >= MAIN_SAMPLES) {
+                detectSet(MAIN_FIRE, baro->time, arrivalUs);
+                break;
+            }
+        }
+        // If the main never comes, we still want to know we're down.
+        /* fall through */
+    case MAIN_OUT:
+        if(detectHeld(abs(vel) <= LANDED_VVEL, baro->time, LANDED_MS))
+            detectSet(LANDED, baro->time, arrivalUs);
+        break;
+    default:
+        break;
+    }
+
+    detectWorst(&baroWorst, arrivalUs);
+}
+
+/* Gets the worst latency seen so far from each sensor, in us */
+void detectLatency(uint32_t * imuUs, uint32_t * baroUs) {
+    *imuUs = imuWorst;
+    *baroUs = baroWorst;
+}
@@ -0,0 +1,333 @@
+#include "estimator.h"
+#include "trace.h"
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#define Q30  (1 << 30)
+#define HALF (1 << 29)     // 0.5 in Q30
+
+/* Mahony gains, per second. KP of 1 pulls the attitude in with a time
+ * constant of about 1 s, and KI of 0.05 soaks up any gyro bias. The gains
+ * are folded into the IMU period in estInit, so these are per us:
+ *  - the gyro's half angle per step per cdps, in Q46, is pi / 18000 / 2e6
+ *  - KP times half a step, in Q30, is 2^30 / 2e6
+ *  - KI times half a step squared, in Q40, is KI * 2^40 / 2e12, per us^2 */
+#define GYRO_PER_US 6141
+#define KP_PER_US   537
+#define KI_PER_400  11     // Per 400 us^2
+#define BIAS_LIMIT  500    // Biggest gyro bias soaked up, cdps
+
+// The accelerometer only corrects the attitude while within this of 1 g
+#define ACCL_GATE (G_CMSS / 8)
+
+// The compass is ignored when less than 1 / 2^COMP_FLAT_SHIFT of the field
+// is horizontal, which is a dip over 75 degrees.
+#define COMP_FLAT_SHIFT 2
+
+/* Steady state Kalman gains in Q16, for a baro at 20 Hz (HP_PERIOD_MS in
+ * the sampler) with 1 m of noise, and 2 m/s^2 of noise on the vertical
+ * acceleration to cover the attitude being a little off. */
+#define K_ALT 6236
+#define K_VEL 6234         // Per second
+
+// The pad's altitude follows the baro with this time constant, in samples
+#define GROUND_SHIFT 4
+
+/* Altitude in cm of the standard atmosphere every ALT_P_STEP Pa from
+ * ALT_P_MIN up, linearly interpolated. Under 1 m out anywhere in the
+ * table, and only the difference from the pad is used. */
+#define ALT_P_MIN  30000
+#define ALT_P_STEP 1000
+#define ALT_P_N    81
+
+static const int32_t altTable[ALT_P_N] = {
+    916395, 894387, 872946, 852041, 831644, 811726, 792264, 773235, 754617,
+    736393, 718543, 701051, 683900, 667078, 650569, 634361, 618443, 602802,
+    587428, 572312, 557443, 542813, 528414, 514237, 500275, 486521, 472968,
+    459610, 446440, 433452, 420642, 408003, 395531, 383221, 371068, 359068,
+    347217, 335510, 323943, 312514, 301218, 290052, 279012, 268096, 257300,
+    246622, 236059, 225607, 215265, 205030, 194899, 184870, 174940, 165109,
+    155373, 145730, 136179, 126717, 117342, 108054, 98850, 89728, 80687,
+    71726, 62842, 54034, 45301, 36641, 28053, 19536, 11088, 2709, -5604,
+    -13851, -22033, -30152, -38208, -46204, -54138, -62014, -69831
+};
+
+// Constants for the IMU period, see estInit
+static int32_t kGyro;      // Q46 half angle per step, per cdps
+static int32_t kP;         // Q30
+static int32_t kI;         // Q40
+static int64_t iLimit;     // Q40
+static int32_t dt24;       // IMU period, s in Q24
+
+// Attitude
+static int32_t q[4];       // Body to earth, Q30. w, x, y, z
+static int32_t up[3];      // Earth's up in the body frame, Q30
+static int64_t integral[3];// Gyro bias, as a Q40 half angle per step
+static int32_t magErr[3];  // Compass error waiting for the next step, Q30
+static bool attPrimed;
+
+// Altitude, both in Q24
+static int64_t alt;        // cm above the pad
+static int64_t vel;        // cm/s, positive going up
+static int32_t ground;     // The pad's altitude, cm
+static bool altPrimed;
+
+/* ---------------------- HELPERS ----------------------- */
+
+static inline int32_t mul30(int32_t a, int32_t b) {
+    return ((int64_t) a * b) >> 30;
+}
+
+/* Integer square root */
+static uint32_t isqrt(uint32_t x) {
+    uint32_t r = 0, b = 1u << 30;
+
+    while(b > x)
+        b >>= 2;
+    while(b) {
+        if(x >= r + b) {
+            x -= r + b;
+            r = (r >> 1) + b;
+        } else {
+            r >>= 1;
+        }
+        b >>= 2;
+    }
+    return r;
+}
+
+/* Scales a reading to a Q30 unit vector.
+ * Returns its length in the reading's units, 0 if it has none. */
+static uint32_t unit(const int16_t in[3], int32_t out[3]) {
+    uint32_t n = isqrt((uint32_t) (in[0] * in[0]) + (uint32_t) (in[1] * in[1])
+                     + (uint32_t) (in[2] * in[2]));
+    int32_t r;
+    int i;
+
+    if(!n)
+        return 0;
+
+    // No axis is longer than the whole, so this cant overflow
+    r = Q30 / n;
+    for(i = 0; i < 3; i++)
+        out[i] = in[i] * r;
+    return n;
+}
+
+/* Works out where earth's up is in the body frame */
+static void findUp(void) {
+    up[0] = 2 * (mul30(q[1], q[3]) - mul30(q[0], q[2]));
+    up[1] = 2 * (mul30(q[0], q[1]) + mul30(q[2], q[3]));
+    up[2] = mul30(q[0], q[0]) - mul30(q[1], q[1])
+          - mul30(q[2], q[2]) + mul30(q[3], q[3]);
+}
+
+/* Sets the attitude to the smallest rotation that puts up along a, with
+ * no yaw. Upside down is a special case. */
+static void primeAttitude(const int32_t a[3]) {
+    uint32_t half = ((int64_t) Q30 + a[2]) >> 1;
+    int32_t n;
+
+    memset(q, 0, sizeof(q));
+    if(half < Q30 >> 16) {
+        q[1] = Q30;
+    } else {
+        n = isqrt(half) << 15;
+        q[0] = ((int64_t) half << 30) / n;
+        q[1] = ((int64_t) (a[1] >> 1) << 30) / n;
+        q[2] = ((int64_t) (-a[0] >> 1) << 30) / n;
+    }
+    attPrimed = true;
+}
+
+/* Interpolates the altitude of a pressure in altTable. Returns cm. */
+static int32_t baroAlt(uint32_t pres) {
+    uint32_t i, f;
+
+    pres = MIN(MAX(pres, ALT_P_MIN), ALT_P_MIN + (ALT_P_N - 1) * ALT_P_STEP - 1);
+    i = (pres - ALT_P_MIN) / ALT_P_STEP;
+    f = (pres - ALT_P_MIN) % ALT_P_STEP;
+    return altTable[i] + (altTable[i + 1] - altTable[i]) * (int32_t) f / ALT_P_STEP;
+}
+
+/* ------------------ PUBLIC FUNCTIONS ------------------ */
+
+/* Resets the estimator for an IMU sampling every dtUs, up to 64 ms */
+void estInit(uint32_t dtUs) {
+    kGyro = dtUs * GYRO_PER_US;
+    kP = dtUs * KP_PER_US;
+    kI = dtUs * dtUs / 400 * KI_PER_400;
+    iLimit = ((int64_t) BIAS_LIMIT * kGyro) >> 6;
+    dt24 = ((int64_t) dtUs << 24) / 1000000;
+
+    memset(integral, 0, sizeof(integral));
+    memset(magErr, 0, sizeof(magErr));
+    attPrimed = false;
+    altPrimed = false;
+}
+
+/* Steps the attitude and altitude on by one IMU sample. The attitude is
+ * turned through half the angle each way, q += q * (0, w), then pulled back
+ * to unit length with a step of Newton's method, as it is never far off. */
+void estImu(const int16_t accl[3], const int16_t gyro[3]) {
+    int32_t a[3], e[3] = {0}, w[3], dq[4], aUp, n2, s;
+    uint32_t len;
+    int i;
+    uint32_t start = traceStart();
+
+    len = unit(accl, a);
+    if(!attPrimed) {
+        if(!len) {
+            traceEnd(TR_EST, start);
+            return;
+        }
+        primeAttitude(a);
+    }
+    findUp();
+
+    // Vertical acceleration, with gravity taken out. up is under 2^15 in
+    // Q15, so only the sum of the products can get near 2^31.
+    aUp = ((up[0] >> 15) * accl[0] + (up[1] >> 15) * accl[1]
+         + (up[2] >> 15) * accl[2]) >> 15;
+    aUp -= G_CMSS;
+    vel += (int64_t) aUp * dt24;
+    alt += (vel * dt24) >> 24;
+
+    // Attitude error off gravity, a x up
+    if(len > G_CMSS - ACCL_GATE && len < G_CMSS + ACCL_GATE) {
+        e[0] = mul30(a[1], up[2]) - mul30(a[2], up[1]);
+        e[1] = mul30(a[2], up[0]) - mul30(a[0], up[2]);
+        e[2] = mul30(a[0], up[1]) - mul30(a[1], up[0]);
+    }
+
+    // Only gravity is trusted to find the gyro's bias. The compass has the
+    // motor and everything else on the board to contend with.
+    for(i = 0; i < 3; i++) {
+        integral[i] += ((int64_t) e[i] * kI) >> 30;
+        integral[i] = MIN(MAX(integral[i], -iLimit), iLimit);
+
+        e[i] += magErr[i];
+        magErr[i] = 0;
+
+        // Half the angle turned this step, Q30
+        w[i] = (((int64_t) gyro[i] * kGyro) >> 16) + mul30(e[i], kP)
+             + (int32_t) (integral[i] >> 10);
+    }
+
+    dq[0] = -mul30(q[1], w[0]) - mul30(q[2], w[1]) - mul30(q[3], w[2]);
+    dq[1] =  mul30(q[0], w[0]) + mul30(q[2], w[2]) - mul30(q[3], w[1]);
+    dq[2] =  mul30(q[0], w[1]) - mul30(q[1], w[2]) + mul30(q[3], w[0]);
+    dq[3] =  mul30(q[0], w[2]) + mul30(q[1], w[1]) - mul30(q[2], w[0]);
+
+    n2 = 0;
+    for(i = 0; i < 4; i++) {
+        q[i] += dq[i];
+        n2 += mul30(q[i], q[i]);
+    }
+
+    // 1 / sqrt(n2) is about (3 - n2) / 2 this close to 1
+    s = Q30 + (Q30 - n2) / 2;
+    for(i = 0; i < 4; i++)
+        q[i] = mul30(q[i], s);
+
+    traceEnd(TR_EST, start);
+}
+
+/* Corrects yaw off a compass sample. The field is turned into earth's
+ * frame and flattened onto north, then the error between that turned back
+ * and the reading is kept to its part about earth's up. It is used on the
+ * next IMU step, so it carries less weight the slower the compass. Yaw
+ * settles at KP with a compass sample every IMU sample. */
+void estComp(const int16_t mag[3]) {
+    int32_t m[3], w[3], e[3], hx, hy, bx, bx2, bz, d;
+    int32_t q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+    int i;
+
+    if(!attPrimed || !unit(mag, m))
+        return;
+
+    q0q1 = mul30(q[0], q[1]);
+    q0q2 = mul30(q[0], q[2]);
+    q0q3 = mul30(q[0], q[3]);
+    q1q1 = mul30(q[1], q[1]);
+    q1q2 = mul30(q[1], q[2]);
+    q1q3 = mul30(q[1], q[3]);
+    q2q2 = mul30(q[2], q[2]);
+    q2q3 = mul30(q[2], q[3]);
+    q3q3 = mul30(q[3], q[3]);
+
+    // The field in earth's frame
+    hx = 2 * (mul30(m[0], HALF - q2q2 - q3q3) + mul30(m[1], q1q2 - q0q3)
+            + mul30(m[2], q1q3 + q0q2));
+    hy = 2 * (mul30(m[0], q1q2 + q0q3) + mul30(m[1], HALF - q1q1 - q3q3)
+            + mul30(m[2], q2q3 - q0q1));
+    bz = 2 * (mul30(m[0], q1q3 - q0q2) + mul30(m[1], q2q3 + q0q1)
+            + mul30(m[2], HALF - q1q1 - q2q2));
+    hx >>= 15;
+    hy >>= 15;
+    bx = isqrt(hx * hx + hy * hy) << 15;
+    bx2 = mul30(bx, bx);
+    if(bx2 < Q30 >> (2 * COMP_FLAT_SHIFT))
+        return;
+
+    // North turned back into the body frame
+    w[0] = 2 * (mul30(bx, HALF - q2q2 - q3q3) + mul30(bz, q1q3 - q0q2));
+    w[1] = 2 * (mul30(bx, q1q2 - q0q3) + mul30(bz, q0q1 + q2q3));
+    w[2] = 2 * (mul30(bx, q0q2 + q1q3) + mul30(bz, HALF - q1q1 - q2q2));
+
+    e[0] = mul30(m[1], w[2]) - mul30(m[2], w[1]);
+    e[1] = mul30(m[2], w[0]) - mul30(m[0], w[2]);
+    e[2] = mul30(m[0], w[1]) - mul30(m[1], w[0]);
+
+    // The error only sees the horizontal part of the field, twice over, so
+    // scale that back out to get the sine of the yaw error
+    d = mul30(e[0], up[0]) + mul30(e[1], up[1]) + mul30(e[2], up[2]);
+    d = ((int64_t) d << 30) / bx2;
+    for(i = 0; i < 3; i++)
+        magErr[i] += mul30(d, up[i]);
+}
+
+/* Corrects altitude off a baro sample */
+void estBaro(uint32_t pres, bool pad) {
+    int32_t h = baroAlt(pres);
+    int64_t r;
+
+    if(!altPrimed) {
+        ground = h;
+        alt = 0;
+        vel = 0;
+        altPrimed = true;
+    } else if(pad) {
+        ground += (h - ground) >> GROUND_SHIFT;
+    }
+
+    r = ((int64_t) (h - ground) << 24) - alt;
+    alt += (r * K_ALT) >> 16;
+    vel += (r * K_VEL) >> 16;
+}
+
+/* Works out the pressure cm above where the baro reads pres, off the same
+ * table as the estimate */
+uint32_t estPresAbove(uint32_t pres, int32_t cm) {
+    int32_t h = baroAlt(pres) + cm;
+    uint32_t i;
+
+    h = MIN(MAX(h, altTable[ALT_P_N - 1]), altTable[0]);
+    for(i = 0; i < ALT_P_N - 2 && altTable[i + 1] > h; i++);
+    return ALT_P_MIN + i * ALT_P_STEP +
+        (int64_t) (altTable[i] - h) * ALT_P_STEP / (altTable[i] - altTable[i + 1]);
+}
+
+/* Gets the current estimate as a log record */
+est_t estGet(uint32_t time) {
+    est_t out;
+    int i;
+
+    out.time = time;
+    for(i = 0; i < 4; i++)
+        out.quat[i] = q[i] >> 16;
+    out.alt = alt >> 24;
+    out.vVel = (vel >> 24) / 10;
+    return out;
+}
@@ -0,0 +1,76 @@
+#include "filter.h"
+
+/* ----------------------- BIQUADS ------------------------ */
+
+/* Clears a biquad's state, so the next sample primes it again */
+void biquadReset(biquadState_t * st) {
+    st->x[0] = st->x[1] = 0;
+    st->y[0] = st->y[1] = 0;
+    st->primed = false;
+}
+
+/* Fills the history as if x had always been the input, so a filter started
+ * on a 100 kPa baro reading doesnt see a 100 kPa step. Only runs once, so
+ * the division doesnt matter. */
+static void biquadPrime(const biquad_t * f, biquadState_t * st, int32_t x) {
+    int32_t num = f->b[0] + f->b[1] + f->b[2];
+    int32_t den = (1 << f->shift) + f->a[0] + f->a[1];
+
+    st->x[0] = st->x[1] = x;
+    st->y[0] = st->y[1] = den ? x * num / den : 0;
+    st->primed = true;
+}
+
+/* Runs one sample through a biquad.
+ * Returns the filtered sample. */
+int32_t biquadStep(const biquad_t * f, biquadState_t * st, int32_t x) {
+    int32_t acc;
+
+    if(!st->primed)
+        biquadPrime(f, st, x);
+
+    acc = f->b[0] * x + f->b[1] * st->x[0] + f->b[2] * st->x[1]
+        - f->a[0] * st->y[0] - f->a[1] * st->y[1];
+
+    // Round to nearest rather than towards -inf, or small signals drift
+    if(f->shift)
+        acc = (acc + (1 << (f->shift - 1))) >> f->shift;
+
+    st->x[1] = st->x[0];
+    st->x[0] = x;
+    st->y[1] = st->y[0];
+    st->y[0] = acc;
+
+    return acc;
+}
+
+/* ------------------- MOVING AVERAGES -------------------- */
+
+/* Sets up a moving average over 2^shift samples of buf. shift <= 8 */
+void maInit(movAvg_t * ma, int32_t * buf, uint8_t shift) {
+    ma->buf = buf;
+    ma->sum = 0;
+    ma->shift = shift;
+    ma->idx = 0;
+    ma->primed = false;
+}
+
+/* Runs one sample through a moving average.
+ * Returns the average of the last 2^shift samples. */
+int32_t maStep(movAvg_t * ma, int32_t x) {
+    uint16_t len = 1 << ma->shift;
+    uint16_t i;
+
+    if(!ma->primed) {
+        for(i = 0; i < len; i++)
+            ma->buf[i] = x;
+        ma->sum = x * len;
+        ma->primed = true;
+    }
+
+    ma->sum += x - ma->buf[ma->idx];
+    ma->buf[ma->idx] = x;
+    ma->idx = (ma->idx + 1) & (len - 1);
+
+    return ma->sum >> ma->shift;
+}
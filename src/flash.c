@@ -2,91 +2,678 @@
 #include "hardware/timer.h"
 #include <hardware/sync.h>
 #include "flash.h"
+#include "ring.h"
 #include "taskList.h"
+#include "trace.h"
 
 #include <pico/stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
-// About 2 seconds worth of data, also about half our RAM.
-#define CIRC_BUF  512
-#define PROG_RESERVED (1024 * 1024)
-#define FLASH_SIZE 8 * 1024 * 1024
-#define START_PTR XIP_BASE + PROG_RESERVED
+#ifdef BOB_DUAL_CORE
+#include <pico/multicore.h>
+#endif
+
+// Bytes of history kept ahead of the flash. Same RAM as the old 512 log_t
+// slots, but records are stored at their TRUE_SIZE, so about 3 seconds.
+#define CIRC_BUF  (12 * 1024)
+#define PROG_RESERVED F_PROG_SIZE
+#define FLASH_SIZE (8 * 1024 * 1024)
+
+// The first sector after the program holds config records. It isnt part of
+// the log, so wiping the log leaves the config alone.
+#define CFG_ADR   PROG_RESERVED
+
+// The next holds the session directory, one session_t per flight.
+#define DIR_ADR    (PROG_RESERVED + FLASH_SECTOR_SIZE)
+#define N_SESSIONS ((int) ((FLASH_SECTOR_SIZE - FLASH_PAGE_SIZE) / sizeof(session_t)))
+#define SESSIONS   ((const session_t * ) (XIP_BASE + DIR_ADR))
+#define UNWRITTEN  0xFFFFFFFF
+
+#define LOG_START (PROG_RESERVED + 2 * FLASH_SECTOR_SIZE)
+#define START_PTR XIP_BASE + LOG_START
+#define N_SECTORS ((FLASH_SIZE - LOG_START) / FLASH_SECTOR_SIZE)
+#define SECTOR_PAGES (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+
+/* The directory's last page keeps track of a wipe, so one cut short by a
+ * reboot can be picked back up. fErase writes WIPE_MAGIC at the start of
+ * it, and each sector of the log then has a bit after that, cleared once
+ * the sector is erased. */
+#define WIPE_ADR   (DIR_ADR + FLASH_SECTOR_SIZE - FLASH_PAGE_SIZE)
+#define WIPE_MAGIC 0x45504957     // "WIPE"
+#define WIPE_BITS  (WIPE_ADR + sizeof(uint32_t))
+
+#if (N_SECTORS + 7) / 8 + 4 > FLASH_PAGE_SIZE
+#error "Wipe bitmap doesnt fit in a page"
+#endif
+
+// While grounded, keep this much of the buffer free for the sampler by
+// throwing away the oldest data. The rest is the pre-trigger window.
+#define PRELAUNCH_HEADROOM (CIRC_BUF / 8)
+
+// Once launch is detected, fTask runs at TL_HIGH until the ring is back
+// under this, so the pre-trigger window goes out ahead of everything else.
+#define BURST_LEVEL (CIRC_BUF / 4)
+
+// How often fTask is queued. The headroom has to outlast this at the
+// fastest profile, or the first samples of the flight are dropped.
+#define FLASH_PERIOD_MS 10
 
 // Add on the header to find the actual size of a log.
-#define TRUE_SIZE(a) a + 3
+#define TRUE_SIZE(a) ((a) + 3)
 
-// Increment with loop around
-// This would normaly be a modulo, but ARM doesnt have that.
-#define LOOPINC(i, max) (i + 1) % max;
+// Blank sectors skipped per run of the erase task
+#define ERASE_CHECKS 16
+
+// Biggest a DELTA record can get: header, base type and 8 five byte varints.
+#define DELTA_FIELDS 8
+#define DELTA_MAX    (4 + DELTA_FIELDS * 5)
 
 // Externs
 extern taskList_t tl;
 extern enum states state;
 
-static log_t buf[CIRC_BUF];
-static uint16_t head     = 0;
-static uint16_t tail     = 0;
+// Storage for the sample ring. Records are packed back to back.
+static uint8_t buf[CIRC_BUF];
+static ring_t ring;
+
+/* Records are packed into one page while the other is waiting to be
+ * programmed. Only whole pages are ever written, so writeAdr is always page
+ * aligned and a page never has to be programmed twice. */
+static uint8_t pages[2][FLASH_PAGE_SIZE];
+static uint16_t fillIndex = 0;     // Bytes used in the page being filled
+static uint8_t  fillPage  = 0;     // Index of the page being filled
+static bool     pageReady = false; // Is the other page waiting to be written?
+
+/* IMU, COMP and BARO records are delta coded against the last record of the
+ * same type. The first of each type in a page is always stored in full, so
+ * every page can be decoded on its own. */
+static const uint8_t deltaTypes[] = {IMU, COMP, BARO};
+#define N_DELTA ((int) sizeof(deltaTypes))
+
+static log_t packLast[N_DELTA];    // Last record of each type in the fill page
+static bool  packKey[N_DELTA];     // Does the fill page have a keyframe yet?
+static log_t readLast[N_DELTA];    // Last record of each type seen by fRead
 
 /* The XIP flash is memory-mapped, meaning we can read from it using
  * pointer wizardry. However to write we have to use flash addresses. */
 static void * readPtr    = (void * ) START_PTR;
-static uint32_t writeAdr = PROG_RESERVED;
+static uintptr_t readEnd = XIP_BASE + FLASH_SIZE;
+static uint32_t writeAdr = LOG_START;
+
+/* The session being written, or -1 if one will be opened with the next
+ * page. N_SESSIONS if the directory is full. */
+static int sessIdx = -1;
+static uint32_t sessRecords = 0;   // Records packed since the last session
+
+static uint32_t sectSeq = 0;       // seq for the next sector header
+
+static enum states lastState;      // state at the last fService
+static uint32_t landedMs;          // When it landed, from boot
+
+/* Sectors are erased in the background from eraseAdr onwards. Everything
+ * before it is ready to write, so it doubles as the end of the usable log.
+ * FLASH_SIZE when there is no erase running. Progress is kept in flash too,
+ * see WIPE_ADR. */
+static uint32_t eraseAdr = FLASH_SIZE;
+
+/* In ring mode the log wraps round and overwrites the oldest sectors rather
+ * than stopping when its full. The sector after the one being written is
+ * always erased ahead of time, which keeps a blank sector between the
+ * newest and oldest data for fInit to find. */
+static bool ringLog = false;
+static uint32_t aheadAdr = 0;      // Sector to erase ahead, 0 if none
 
 static repeating_timer_t flashTimer;
 
+// When the flash was last locked, for tracing
+static uint32_t lockStart;
+
+/* --------------------- PROTOTYPES -------------------- */
+
+static void fAheadTask(void * data);
+static void fTask(void * data);
+
 /* ---------------------- HELPERS ----------------------- */
 
-/* Attempts to pop a record from the input buffer */
-static int fPop(log_t * log) {
-    if (head != tail) {
-        memcpy(log, &buf[tail], sizeof(log_t));
-        tail = (tail + 1) % CIRC_BUF;
-        return 0;
-    } else {
-        return 1;
+/* Returns true if a sector is already erased. Reads around the XIP cache so
+ * checking the whole flash doesnt throw out everything else in it. */
+static bool fSectorBlank(uint32_t adr) {
+    const uint32_t * p = (const uint32_t * ) (XIP_NOCACHE_NOALLOC_BASE + adr);
+    uint32_t i;
+
+    for(i = 0; i < FLASH_SECTOR_SIZE / sizeof(uint32_t); i++) {
+        if(p[i] != 0xFFFFFFFF)
+            return false;
+    }
+    return true;
+}
+
+/* Erases a single sector */
+static void fEraseSector(uint32_t adr) {
+    int ints = fLock();
+    flash_range_erase(adr, FLASH_SECTOR_SIZE);
+    fUnlock(ints);
+}
+
+/* Returns the address of the page after adr, wrapping round in ring mode */
+static uint32_t fNextPage(uint32_t adr) {
+    adr += FLASH_PAGE_SIZE;
+    if(ringLog && adr == FLASH_SIZE)
+        adr = LOG_START;
+    return adr;
+}
+
+/* Gets the seq of the nth sector in the log, wrapping round.
+ * Returns true if the sector has a header. */
+static bool fSectorSeq(uint32_t n, uint32_t * seq) {
+    const log_t * l = (const log_t * ) (START_PTR + (n % N_SECTORS) * FLASH_SECTOR_SIZE);
+
+    if(l->marker != 0xAA || l->type != SECT)
+        return false;
+
+    *seq = l->data.sect.seq;
+    return true;
+}
+
+/* --------------------- COMPRESSION -------------------- */
+
+/* Returns the delta context used for a type, or -1 if it isnt delta coded */
+static int fDeltaSlot(uint8_t type) {
+    int i;
+    for(i = 0; i < N_DELTA; i++) {
+        if(deltaTypes[i] == type)
+            return i;
+    }
+    return -1;
+}
+
+/* Pulls the fields of a record out as int32s, time first.
+ * Returns the number of fields. */
+static uint8_t fGetFields(const log_t * l, int32_t * f) {
+    switch(l->type) {
+    case IMU:
+        f[0] = l->data.imu.time;
+        f[1] = l->data.imu.accl[0];
+        f[2] = l->data.imu.accl[1];
+        f[3] = l->data.imu.accl[2];
+        f[4] = l->data.imu.gyro[0];
+        f[5] = l->data.imu.gyro[1];
+        f[6] = l->data.imu.gyro[2];
+        f[7] = l->data.imu.acclFilt;
+        return 8;
+    case COMP:
+        f[0] = l->data.comp.time;
+        f[1] = l->data.comp.compass[0];
+        f[2] = l->data.comp.compass[1];
+        f[3] = l->data.comp.compass[2];
+        return 4;
+    case BARO:
+        f[0] = l->data.baro.time;
+        f[1] = l->data.baro.pres;
+        f[2] = l->data.baro.temp;
+        f[3] = l->data.baro.vVel;
+        return 4;
+    }
+    return 0;
+}
+
+/* The reverse of fGetFields. l->type must already be set. */
+static void fSetFields(log_t * l, const int32_t * f) {
+    switch(l->type) {
+    case IMU:
+        l->size = sizeof(imu_t);
+        l->data.imu.time = f[0];
+        l->data.imu.accl[0] = f[1];
+        l->data.imu.accl[1] = f[2];
+        l->data.imu.accl[2] = f[3];
+        l->data.imu.gyro[0] = f[4];
+        l->data.imu.gyro[1] = f[5];
+        l->data.imu.gyro[2] = f[6];
+        l->data.imu.acclFilt = f[7];
+        break;
+    case COMP:
+        l->size = sizeof(comp_t);
+        l->data.comp.time = f[0];
+        l->data.comp.compass[0] = f[1];
+        l->data.comp.compass[1] = f[2];
+        l->data.comp.compass[2] = f[3];
+        break;
+    case BARO:
+        l->size = sizeof(baro_t);
+        l->data.baro.time = f[0];
+        l->data.baro.pres = f[1];
+        l->data.baro.temp = f[2];
+        l->data.baro.vVel = f[3];
+        break;
+    }
+}
+
+/* Writes v as a zig-zag varint. Returns the number of bytes used. */
+static uint8_t fPutVarint(uint8_t * out, int32_t v) {
+    uint32_t z = ((uint32_t) v << 1) ^ (uint32_t) (v >> 31);
+    uint8_t n = 0;
+
+    while(z >= 0x80) {
+        out[n++] = z | 0x80;
+        z >>= 7;
     }
+    out[n++] = z;
+    return n;
 }
 
-static int fPeek(log_t * log) {
-    if (head != tail) {
-        memcpy(log, &buf[tail], sizeof(log_t));
+/* Reads a zig-zag varint into v. Returns the number of bytes used. */
+static uint8_t fGetVarint(const uint8_t * in, int32_t * v) {
+    uint32_t z = 0;
+    uint8_t n = 0;
+
+    do {
+        z |= (uint32_t) (in[n] & 0x7F) << (7 * n);
+    } while(in[n++] & 0x80 && n < 5);
+
+    *v = (int32_t) (z >> 1) ^ -(int32_t) (z & 1);
+    return n;
+}
+
+/* Attempts to delta code l against the fill page, putting the result in out.
+ * Returns the size of the DELTA record, or 0 if l should be stored as is. */
+static uint8_t fEncode(const log_t * l, uint8_t * out) {
+    int slot = fDeltaSlot(l->type);
+    int32_t now[DELTA_FIELDS], prev[DELTA_FIELDS];
+    uint8_t i, n, size = 4;
+
+    if(slot < 0 || !packKey[slot])
         return 0;
-    } else {
+
+    n = fGetFields(l, now);
+    fGetFields(&packLast[slot], prev);
+
+    for(i = 0; i < n; i++) {
+        size += fPutVarint(out + size, now[i] - prev[i]);
+    }
+
+    // Not worth it
+    if(size >= TRUE_SIZE(l->size))
+        return 0;
+
+    out[0] = 0xAA;
+    out[1] = size - 3;
+    out[2] = DELTA;
+    out[3] = l->type;
+    return size;
+}
+
+/* Makes l the record the next one of its type is coded against */
+static void fRemember(const log_t * l, log_t * last, bool * key) {
+    int slot = fDeltaSlot(l->type);
+
+    if(slot >= 0) {
+        memcpy(&last[slot], l, TRUE_SIZE(l->size));
+        if(key)
+            key[slot] = true;
+    }
+}
+
+/* Expands the DELTA record in into out, using the last record fRead saw.
+ * Returns 0 on success, 1 if the record cant be decoded. */
+static int fDecode(const log_t * in, log_t * out) {
+    const uint8_t * p = (const uint8_t * ) &in->data;
+    const uint8_t * end = p + in->size;
+    int slot = fDeltaSlot(*p++);
+    int32_t f[DELTA_FIELDS], d;
+    uint8_t i, n;
+
+    if(slot < 0)
         return 1;
+
+    n = fGetFields(&readLast[slot], f);
+    for(i = 0; i < n && p < end; i++) {
+        p += fGetVarint(p, &d);
+        f[i] += d;
+    }
+
+    out->marker = 0xAA;
+    out->type = deltaTypes[slot];
+    fSetFields(out, f);
+    return 0;
+}
+
+/* ---------------------- SESSIONS ---------------------- */
+
+/* Programs len bytes at adr, leaving the rest of the page alone. Only for
+ * filling in bytes that are still erased, and must not cross a page. */
+static void fPatch(uint32_t adr, const void * data, uint32_t len) {
+    uint8_t page[FLASH_PAGE_SIZE];
+    uint32_t base = adr & ~(FLASH_PAGE_SIZE - 1);
+    int ints;
+
+    memset(page, 0xFF, FLASH_PAGE_SIZE);
+    memcpy(page + (adr - base), data, len);
+
+    ints = fLock();
+    flash_range_program(base, page, FLASH_PAGE_SIZE);
+    fUnlock(ints);
+}
+
+/* Adds a directory entry for a session starting at writeAdr. The session
+ * before it is closed off here if it never was, though its record count is
+ * lost. */
+static void fOpenSession(void) {
+    session_t sess = {writeAdr, 0, UNWRITTEN, UNWRITTEN};
+    int i;
+
+    for(i = 0; i < N_SESSIONS && SESSIONS[i].start != UNWRITTEN; i++);
+
+    if(i > 0 && SESSIONS[i - 1].end == UNWRITTEN) {
+        fPatch(DIR_ADR + (i - 1) * sizeof(session_t) + offsetof(session_t, end),
+               &writeAdr, sizeof(writeAdr));
+    }
+
+    sessIdx = i;
+    if(i == N_SESSIONS)
+        return;
+
+    sess.time = to_ms_since_boot(get_absolute_time());
+    fPatch(DIR_ADR + i * sizeof(session_t), &sess, sizeof(sess));
+}
+
+/* Clears the wipe bits of log sectors from up to to, now theyre erased.
+ * Only the bytes holding those are programmed, with the bits before from
+ * that share them cleared again so each byte only ever loses bits. */
+static void fWipeMark(uint32_t from, uint32_t to) {
+    uint8_t bits[(N_SECTORS + 7) / 8];
+    uint32_t s, first = from / 8, last = (to - 1) / 8;
+
+    if(from >= to)
+        return;
+
+    memset(bits, 0xFF, sizeof(bits));
+    for(s = first * 8; s < to; s++)
+        bits[s / 8] &= ~(1 << (s % 8));
+    fPatch(WIPE_BITS + first, bits + first, last - first + 1);
+}
+
+/* Finds how far a wipe got.
+ * Returns the first log sector it hasnt erased, or N_SECTORS if there
+ * isnt one unfinished. */
+static uint32_t fWipeLeft(void) {
+    const uint8_t * bits = (const uint8_t * ) (XIP_BASE + WIPE_BITS);
+    uint32_t s;
+
+    if(*(const uint32_t * ) (XIP_BASE + WIPE_ADR) != WIPE_MAGIC)
+        return N_SECTORS;
+
+    for(s = 0; s < N_SECTORS && !(bits[s / 8] & 1 << (s % 8)); s++);
+    return s;
+}
+
+/* ------------------------ PAGES ----------------------- */
+
+/* Hands the page being filled over to be programmed and starts a new one.
+ * Whatever is left at the end of the page stays 0xFF. */
+static void fSwapPage(void) {
+    pageReady = true;
+    fillPage  = !fillPage;
+    fillIndex = 0;
+    memset(pages[fillPage], 0xFF, FLASH_PAGE_SIZE);
+    memset(packKey, 0, sizeof(packKey));
+}
+
+/* In ring mode, makes sure the sector at writeAdr is blank before its first
+ * page goes in, then gets the one after it erased ahead of time. The
+ * sector should already be blank, unless fAheadTask didnt get a chance. */
+static void fRingSector(void) {
+    if(!fSectorBlank(writeAdr))
+        fEraseSector(writeAdr);
+
+    aheadAdr = writeAdr + FLASH_SECTOR_SIZE;
+    if(aheadAdr == FLASH_SIZE)
+        aheadAdr = LOG_START;
+    tlAdd(&tl, fAheadTask, NULL);
+}
+
+/* Programs the waiting page. Interrupts are only off for a single page.
+ * The first page after boot, or after fEndSession, starts a new session. */
+static void fCommitPage(void) {
+    if(sessIdx < 0)
+        fOpenSession();
+
+    if(ringLog && writeAdr % FLASH_SECTOR_SIZE == 0)
+        fRingSector();
+
+    int ints = fLock();
+    flash_range_program(writeAdr, pages[!fillPage], FLASH_PAGE_SIZE);
+    fUnlock(ints);
+
+    writeAdr = fNextPage(writeAdr);
+    pageReady = false;
+}
+
+/* Throws away anything that was staged but not yet written */
+static void fResetPages(void) {
+    pageReady = false;
+    fillIndex = 0;
+    memset(pages[fillPage], 0xFF, FLASH_PAGE_SIZE);
+    memset(packKey, 0, sizeof(packKey));
+}
+
+/* Starts the fill page with a SECT record if it is the first page of a
+ * sector. Call before adding anything else to an empty fill page. */
+static void fPageHeader(void) {
+    uint32_t adr = pageReady ? fNextPage(writeAdr) : writeAdr;
+    log_t * l = (log_t * ) pages[fillPage];
+
+    if(adr % FLASH_SECTOR_SIZE)
+        return;
+
+    l->marker = 0xAA;
+    l->size = sizeof(sect_t);
+    l->type = SECT;
+    l->data.sect.seq = sectSeq++;
+    l->data.sect.time = to_ms_since_boot(get_absolute_time());
+    fillIndex = TRUE_SIZE(sizeof(sect_t));
+}
+
+/* Returns true if a page of the log has been written. Every written page
+ * starts with a record, and the rest of the log is erased. */
+static bool fPageUsed(uint32_t page) {
+    return ((const log_t * ) (START_PTR + page * FLASH_PAGE_SIZE))->marker == 0xAA;
+}
+
+/* Binary search for the first unused page between lo and hi. Used pages
+ * must all come first, so this only takes a handful of reads. */
+static uint32_t fFirstBlank(uint32_t lo, uint32_t hi) {
+    uint32_t mid;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(fPageUsed(mid))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Finds the newest sector of a ring log.
+ * Going forward from any sector with a header, seqs go up by one until the
+ * newest sector and then stop, so we can binary search on that. Theres
+ * only ever one blank sector between the newest and oldest, so one of the
+ * first two sectors will do unless the log is empty.
+ * Returns the sector number, or N_SECTORS if the log is empty. */
+static uint32_t fFindHead(void) {
+    uint32_t anchor, base, seq;
+    uint32_t lo = 0, hi = N_SECTORS, mid;
+
+    if(fSectorSeq(0, &base))
+        anchor = 0;
+    else if(fSectorSeq(1, &base))
+        anchor = 1;
+    else
+        return N_SECTORS;
+
+    while(lo + 1 < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(fSectorSeq(anchor + mid, &seq) && seq == base + mid)
+            lo = mid;
+        else
+            hi = mid;
     }
+    return (anchor + lo) % N_SECTORS;
+}
+
+/* Returns true if a ring log has gone round, so there is older data after
+ * writeAdr. The sector after the one being written may have been erased
+ * ahead, so look at the one after that too. */
+static bool fWrapped(void) {
+    uint32_t sector = (writeAdr - LOG_START) / FLASH_SECTOR_SIZE;
+    uint32_t seq;
+
+    return ringLog && (fSectorSeq(sector + 1, &seq) || fSectorSeq(sector + 2, &seq));
 }
 
 /* ----------------------- TASKS ------------------------ */
 
-/* Checks if there is data, and if we're in an appropriate state to write it,
- * then buffers up about two pages worth, and writes it. */
+/* Packs records from the ring into the fill page until we either have no
+ * more data or both pages are full. */
+static void fPack(void) {
+    log_t * l;
+    uint32_t avail;
+    uint8_t delta[DELTA_MAX];
+    uint8_t size;
+    uint32_t need;
+
+    while((l = (log_t * ) ringPeek(&ring, &avail)) != NULL) {
+        if(fillIndex == 0)
+            fPageHeader();
+
+        size = fEncode(l, delta);
+        need = size ? size : TRUE_SIZE(l->size);
+
+        if(need + fillIndex > FLASH_PAGE_SIZE) {
+            // Both pages are full, wait for the next run.
+            if(pageReady)
+                break;
+            // New page, so this one will be a keyframe.
+            fSwapPage();
+            continue;
+        }
+
+        if(size) {
+            memcpy(pages[fillPage] + fillIndex, delta, size);
+        } else {
+            memcpy(pages[fillPage] + fillIndex, l, TRUE_SIZE(l->size));
+        }
+        fillIndex += need;
+
+        fRemember(l, packLast, packKey);
+        ringRelease(&ring, TRUE_SIZE(l->size));
+        sessRecords++;
+    }
+}
+
+/* Writes everything in the ring and the pages out to flash, including the
+ * part filled page. This can take a while if the ring is full. */
+static void fFlush(void) {
+    while(writeAdr + FLASH_PAGE_SIZE <= eraseAdr) {
+        if(pageReady)
+            fCommitPage();
+
+        fPack();
+
+        if(!pageReady && fillIndex) {
+            fSwapPage();
+        } else if(!pageReady) {
+            break;
+        }
+    }
+}
+
+/* Checks if we're in an appropriate state to write, then programs the page
+ * that filled up last time and packs records into the other one.
+ * At most one page is programmed per run; if another fills up, the task
+ * requeues itself so everything else gets a look-in between pages. Right
+ * after launch the whole pre-trigger window is waiting, so it requeues at
+ * TL_HIGH alongside the sensors until it has caught up. */
+static void fService(void) {
+    log_t * l;
+    uint32_t avail;
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    bool landedDone;
+
+    if(state == LANDED && lastState != LANDED)
+        landedMs = now;
+    lastState = state;
+    landedDone = state == LANDED && now - landedMs >= F_LANDED_MS;
+
+    // While we're on the ground, just make sure the sampler has room. Once
+    // we've been landed a while, write out whats left of the flight and
+    // close it first.
+    if(state == GROUNDED || state == BOOT || landedDone) {
+        if(sessIdx >= 0)
+            fEndSession();
+
+        while(ringUsed(&ring) > sizeof(buf) - PRELAUNCH_HEADROOM
+           && (l = (log_t * ) ringPeek(&ring, &avail)) != NULL) {
+            ringRelease(&ring, TRUE_SIZE(l->size));
+        }
+        return;
+    }
+
+    // Is there room? If an erase is running, it might not be ready yet.
+    if(writeAdr + FLASH_PAGE_SIZE > eraseAdr) {
+        return;
+    }
+
+    if(pageReady) {
+        fCommitPage();
+    }
+
+    fPack();
+
+    if(pageReady) {
+        tlAddPrio(&tl, ringUsed(&ring) > BURST_LEVEL ? TL_HIGH : TL_NORM,
+                  fTask, NULL);
+    }
+}
+
+/* Timed wrapper for fService, run off the flash timer */
 static void fTask(void * data) {
-    uint32_t mask         = ~0xFF;
-    uint16_t writeIndex   = writeAdr & 0xFF;
-    uint16_t bytesWritten = 0;
-    uint8_t writeBuf[512];
-    log_t l;
-
-    memset(writeBuf, 0xFF, 512);
-
-    if(state != GROUNDED && state != BOOT           // Are we in the right state?
-    && !fPeek(&l) && writeAdr + 512 < FLASH_SIZE) { // Is there data and room?
-        // Pack the write buffer until we either have no more data or no room.
-        while (!fPeek(&l) && TRUE_SIZE(l.size) + writeIndex <= 512 ) {
-            fPop(&l); // Kinda redundant. Its 2am.
-            memcpy(writeBuf + writeIndex, &l, TRUE_SIZE(l.size));
-            writeIndex += TRUE_SIZE(l.size);
-            bytesWritten += TRUE_SIZE(l.size);
+    uint32_t start = traceStart();
+
+    fService();
+    traceEnd(TR_FTASK, start);
+}
+
+/* Erases the next sector that needs it, skipping any that are already
+ * blank, then requeues itself until it reaches the end of the flash.
+ * Interrupts are only off for one sector at a time. */
+static void fEraseTask(void * data) {
+    uint32_t from = (eraseAdr - LOG_START) / FLASH_SECTOR_SIZE;
+    int i;
+
+    for(i = 0; i < ERASE_CHECKS && eraseAdr < FLASH_SIZE; i++) {
+        if(!fSectorBlank(eraseAdr)) {
+            fEraseSector(eraseAdr);
+            eraseAdr += FLASH_SECTOR_SIZE;
+            break;
         }
+        eraseAdr += FLASH_SECTOR_SIZE;
+    }
+    fWipeMark(from, (eraseAdr - LOG_START) / FLASH_SECTOR_SIZE);
 
-        int ints = save_and_disable_interrupts();
-        flash_range_program (writeAdr & mask, writeBuf, 512);
-        restore_interrupts(ints);
-        writeAdr += bytesWritten;
+    if(eraseAdr < FLASH_SIZE) {
+        tlAdd(&tl, fEraseTask, NULL);
     }
+}
 
+/* Erases the sector after the one being written in ring mode, if it needs
+ * it. Kept out of fTask so the sample ring can be emptied first. */
+static void fAheadTask(void * data) {
+    if(aheadAdr && !fSectorBlank(aheadAdr))
+        fEraseSector(aheadAdr);
+    aheadAdr = 0;
 }
 
 /* ----------------------- IRQs ------------------------  */
@@ -98,75 +685,331 @@ static bool flashIRQ(repeating_timer_t *rt) {
 
 /* ------------------ PUBLIC FUNCTIONS ------------------ */
 
-/* Reads the next log from the flash and puts it into buf */
+/* Nothing can run from flash while its being written, so this keeps
+ * everything off it until fUnlock. In dual core mode the sampler core is
+ * parked in RAM for the duration; its timers keep counting, and the sensor
+ * FIFOs keep filling, so it picks back up where it left off.
+ * Returns the interrupt state to hand to fUnlock. */
+int fLock(void) {
+    int ints = save_and_disable_interrupts();
+    lockStart = traceStart();
+#ifdef BOB_DUAL_CORE
+    multicore_lockout_start_blocking();
+#endif
+    return ints;
+}
+
+/* Lets everything back onto the flash */
+void fUnlock(int ints) {
+#ifdef BOB_DUAL_CORE
+    multicore_lockout_end_blocking();
+#endif
+    traceEnd(TR_IRQS_OFF, lockStart);
+    restore_interrupts(ints);
+}
+
+/* Gets the next log in flash without copying it.
+ * Returns a pointer straight into the memory mapped flash, or to a decoded
+ * copy for DELTA records. Either way it is only valid until the next call.
+ * NULL once there are no more logs. */
+const log_t * fNext(void) {
+    static log_t decoded;
+    const log_t * ptr = (const log_t * ) readPtr;
+
+    // Records never straddle a page, so skip over any padding at the end.
+    if(ptr->marker != 0xAA && ((uintptr_t) readPtr & (FLASH_PAGE_SIZE - 1))) {
+        readPtr = (void * ) (((uintptr_t) readPtr | (FLASH_PAGE_SIZE - 1)) + 1);
+        ptr = (const log_t * ) readPtr;
+    }
+
+    // A ring log carries on from the start.
+    if(ringLog && (uintptr_t) readPtr == XIP_BASE + FLASH_SIZE) {
+        readPtr = (void * ) START_PTR;
+        ptr = (const log_t * ) readPtr;
+    }
+
+    // Anything past an erase thats still running is old data.
+    if((uintptr_t) readPtr >= MIN(readEnd, XIP_BASE + eraseAdr)
+    || ptr->marker != 0xAA) {
+        return NULL;
+    }
+
+    readPtr += TRUE_SIZE(ptr->size);
+
+    if(ptr->type == DELTA && !fDecode(ptr, &decoded)) {
+        ptr = &decoded;
+    }
+
+    fRemember(ptr, readLast, NULL);
+    return ptr;
+}
+
+/* Reads the next log from the flash and puts it into buf.
+ * DELTA records are expanded back into the record they were made from. */
 int fRead(log_t * buf) {
-    log_t * ptr = (log_t * ) readPtr;
-    if(ptr->marker == 0xAA) {
-        memcpy(buf, ptr, sizeof(log_t));
-        readPtr += TRUE_SIZE(ptr->size);
-        return 0;
-    } else {
+    const log_t * ptr = fNext();
+
+    if(ptr == NULL) {
         return 1;
     }
-}
 
-/* Creates a log from data and pushes it to the circular buffer
- * N.B. May overwrite data if the circular buffer is full. */
-void fPush(uint8_t * data, uint8_t size, enum types type) {
-    log_t l;
+    memcpy(buf, ptr, MIN(TRUE_SIZE(ptr->size), sizeof(log_t)));
+    return 0;
+}
 
-    // Set e to 0xFF to avoid writing nonsense.
-    memset(&l, 0xFF, sizeof(log_t));
+/* Creates a log from data and pushes it to the sample ring.
+ * The record is built in place, so this is safe to call from an IRQ, or from
+ * the other core, as long as only one context pushes at a time. */
+void fPush(const void * data, uint8_t size, enum types type) {
+    log_t * l = (log_t * ) ringReserve(&ring, TRUE_SIZE(size));
 
-    // Package up the rest of the entry
-    l.marker = 0xAA;
-    l.size = size;
-    l.type = type;
-    memcpy(&l.data, data, size);
+    // No room. The ring keeps count, so just give up.
+    if(l == NULL) {
+        return;
+    }
 
-    buf[head] = l;
+    // Package up the entry. Only TRUE_SIZE bytes are ours to write.
+    l->marker = 0xAA;
+    l->size = size;
+    l->type = type;
+    memcpy(&l->data, data, size);
 
-    // Increment read pointer
-    head = LOOPINC(head, CIRC_BUF);
+    ringCommit(&ring, TRUE_SIZE(size));
+}
 
-    // Increment write ptr if needed
-    if (head == tail) {
-        tail = LOOPINC(tail, CIRC_BUF);
-    }
+/* Returns the number of records the sample ring has had to drop */
+uint32_t fDropped(void) {
+    return ring.dropped;
 }
 
-/* Erases all data in the flash.
- * Returns nothing. If the erase fails, the 2040 will hardfault >:( */
+/* Erases the session directory and starts erasing the log in the
+ * background, and starts a new log. The config is left alone. Logging
+ * carries on as soon as the first sectors are ready. */
 void fErase(void) {
-    int ints = save_and_disable_interrupts();
-    flash_range_erase (PROG_RESERVED, FLASH_SIZE - PROG_RESERVED);
-    restore_interrupts(ints);
+    const uint32_t magic = WIPE_MAGIC;
+    bool running = eraseAdr < FLASH_SIZE;
+
+    // The directory goes straight away, so the wipe is marked in flash
+    // before any of the log is touched.
+    fEraseSector(DIR_ADR);
+    fPatch(WIPE_ADR, &magic, sizeof(magic));
+
+    eraseAdr = LOG_START;
+    if(!running) {
+        tlAdd(&tl, fEraseTask, NULL);
+    }
 
     readPtr  = (void * ) START_PTR;
-    writeAdr = PROG_RESERVED;
+    readEnd  = XIP_BASE + FLASH_SIZE;
+    writeAdr = LOG_START;
+    sectSeq  = 0;
+    sessIdx  = -1;
+    sessRecords = 0;
+    aheadAdr = 0;
+    fResetPages();
+}
+
+/* Returns how far through an erase we are, in percent. 100 if there isnt
+ * one running. */
+int fEraseProgress(void) {
+    return (uint64_t) (eraseAdr - LOG_START) * 100 / (FLASH_SIZE - LOG_START);
 }
 
-/* Puts the read pointer back at the start */
+/* Puts the read pointer back at the start. For a ring log thats the oldest
+ * sector, the first one with a header after writeAdr. */
 void fRewind(void) {
+    uint32_t sector = (writeAdr - LOG_START) / FLASH_SECTOR_SIZE;
+    uint32_t i, seq;
+
     readPtr  = (void * ) START_PTR;
+    readEnd  = XIP_BASE + FLASH_SIZE;
+    memset(readLast, 0, sizeof(readLast));
+
+    // Whats past a running erase is old, so theres nothing to wrap round to
+    for(i = 1; ringLog && eraseAdr == FLASH_SIZE && i <= N_SECTORS; i++) {
+        if(fSectorSeq(sector + i, &seq)) {
+            readPtr = (void * ) (START_PTR + ((sector + i) % N_SECTORS) * FLASH_SECTOR_SIZE);
+            break;
+        }
+    }
+}
+
+/* Flushes everything logged so far and closes the current session, so the
+ * next page written starts a new one. */
+void fEndSession(void) {
+    uint32_t tail[2];   // end and records, which sit next to each other
+
+    if(sessIdx < 0)
+        return;
+
+    fFlush();
+
+    if(sessIdx < N_SESSIONS) {
+        tail[0] = writeAdr;
+        tail[1] = sessRecords;
+        fPatch(DIR_ADR + sessIdx * sizeof(session_t) + offsetof(session_t, end),
+               tail, sizeof(tail));
+    }
+
+    sessIdx = -1;
+    sessRecords = 0;
+}
+
+/* Returns the number of sessions in the directory */
+int fSessions(void) {
+    int i;
+    for(i = 0; i < N_SESSIONS && SESSIONS[i].start != UNWRITTEN; i++);
+    return i;
+}
+
+/* Copies a session's directory entry into sess. If the session was never
+ * closed, its end is taken as the end of the log.
+ * Returns 0 on success, 1 if theres no such session. */
+int fGetSession(int n, session_t * sess) {
+    if(n < 0 || n >= fSessions())
+        return 1;
+
+    *sess = SESSIONS[n];
+    if(sess->end == UNWRITTEN)
+        sess->end = writeAdr;
+    return 0;
+}
+
+/* Points the read pointer at the start of a session, so fRead only returns
+ * that sessions records.
+ * Returns 0 on success, 1 if theres no such session. */
+int fSeekSession(int n) {
+    session_t sess;
+
+    if(fGetSession(n, &sess))
+        return 1;
+
+    readPtr = (void * ) (XIP_BASE + sess.start);
+    readEnd = XIP_BASE + sess.end;
+    memset(readLast, 0, sizeof(readLast));
+    return 0;
+}
+
+/* Gets the raw log, from the start up to the last page written. The flash
+ * is memory mapped, so this is just a pointer into it. */
+const uint8_t * fRawLog(uint32_t * len) {
+    *len = fWrapped() ? FLASH_SIZE - LOG_START : writeAdr - LOG_START;
+    return (const uint8_t * ) START_PTR;
 }
 
 /* Returns total flash used in kiB */
 int fUsed(void) {
-    return (writeAdr - PROG_RESERVED) >> 10;
+    if(fWrapped())
+        return (FLASH_SIZE - LOG_START) >> 10;
+    return (writeAdr - LOG_START) >> 10;
 }
 
-/* Spins up the flash task and associated timers. */
-void fInit(void) {
-    log_t l;
+/* Loads the newest config saved in flash into cfg.
+ * Each save takes up a page of the config sector, the last one wins.
+ * Returns 0 on success, 1 if there isnt one. */
+int fLoadConfig(conf_t * cfg) {
+    const log_t * l;
+    uint32_t adr;
+    int found = 1;
+
+    for(adr = CFG_ADR; adr < CFG_ADR + FLASH_SECTOR_SIZE; adr += FLASH_PAGE_SIZE) {
+        l = (const log_t * ) (XIP_BASE + adr);
+        if(l->marker != 0xAA)
+            break;
+
+        // conf_t only ever grows, so an older build's config is a prefix of
+        // ours. Whatever it didnt have is left at 0. Anything bigger is
+        // from a newer build, so ignore it.
+        if(l->type == CFG && l->size <= sizeof(conf_t)) {
+            memset(cfg, 0, sizeof(conf_t));
+            memcpy(cfg, &l->data.conf, l->size);
+            found = 0;
+        }
+    }
+
+    return found;
+}
+
+/* Saves cfg to the config sector, erasing it first if its full. */
+void fSaveConfig(const conf_t * cfg) {
+    uint8_t page[FLASH_PAGE_SIZE];
+    log_t * l = (log_t * ) page;
+    uint32_t adr;
+    int ints;
+
+    // Find the first free page
+    for(adr = CFG_ADR; adr < CFG_ADR + FLASH_SECTOR_SIZE; adr += FLASH_PAGE_SIZE) {
+        if(((const log_t * ) (XIP_BASE + adr))->marker != 0xAA)
+            break;
+    }
+
+    memset(page, 0xFF, FLASH_PAGE_SIZE);
+    l->marker = 0xAA;
+    l->size = sizeof(conf_t);
+    l->type = CFG;
+    l->data.conf = *cfg;
+
+    ints = fLock();
+    if(adr == CFG_ADR + FLASH_SECTOR_SIZE) {
+        flash_range_erase(CFG_ADR, FLASH_SECTOR_SIZE);
+        adr = CFG_ADR;
+    }
+    flash_range_program(adr, page, FLASH_PAGE_SIZE);
+    fUnlock(ints);
+}
+
+/* Spins up the flash task and associated timers. cfg picks between a
+ * linear log and a ring log. A wipe that was cut short is picked back up,
+ * and only whats before where it got to is kept. */
+void fInit(const conf_t * cfg) {
+    const log_t * l;
+    uint32_t head, page, wiped;
+
+    ringInit(&ring, buf, sizeof(buf));
+    ringLog = cfg->ringLog;
+    eraseAdr = FLASH_SIZE;
+    wiped = fWipeLeft();
+
+    if(ringLog && wiped == N_SECTORS) {
+        head = fFindHead();
+        if(head == N_SECTORS) {
+            writeAdr = LOG_START;
+            sectSeq = 0;
+        } else {
+            // Pick up after the last page of the newest sector
+            page = fFirstBlank(head * SECTOR_PAGES, (head + 1) * SECTOR_PAGES);
+            writeAdr = LOG_START + page * FLASH_PAGE_SIZE;
+            if(writeAdr == FLASH_SIZE)
+                writeAdr = LOG_START;
+
+            fSectorSeq(head, &sectSeq);
+            sectSeq++;
+        }
+    } else {
+        // Pick up from the next free page. Anything the wipe hadnt got to
+        // yet isnt part of the log.
+        page = fFirstBlank(0, wiped * SECTOR_PAGES);
+        writeAdr = LOG_START + page * FLASH_PAGE_SIZE;
+
+        // Carry on counting from the last sector, if it has a header.
+        sectSeq = (writeAdr - LOG_START) / FLASH_SECTOR_SIZE;
+        if(page) {
+            l = (const log_t * ) (XIP_BASE + ((writeAdr - 1) & ~(FLASH_SECTOR_SIZE - 1)));
+            if(l->marker == 0xAA && l->type == SECT)
+                sectSeq = l->data.sect.seq + 1;
+        }
+    }
 
-    // Figure out whats already in flash
-    while(!fRead(&l)) {
-        asm volatile("nop");
+    if(wiped < N_SECTORS) {
+        eraseAdr = LOG_START + wiped * FLASH_SECTOR_SIZE;
+        tlAdd(&tl, fEraseTask, NULL);
     }
 
-    writeAdr = ((int) readPtr) - XIP_BASE;
-    readPtr = (void *) START_PTR;
+    fRewind();
+    sessIdx = -1;
+    sessRecords = 0;
+    aheadAdr = 0;
+    fResetPages();
 
-    add_repeating_timer_ms(100, flashIRQ, NULL, &flashTimer);
+    add_repeating_timer_ms(FLASH_PERIOD_MS, flashIRQ, NULL, &flashTimer);
 }
@@ -0,0 +1,168 @@
+#include "gps.h"
+#include "bob.h"
+#include "flash.h"
+#include "nmea.h"
+#include "taskList.h"
+#include "types.h"
+
+#include <pico/stdlib.h>
+#include <hardware/irq.h>
+#include <hardware/uart.h>
+
+// Helper functions
+#define NOW_MS to_ms_since_boot(get_absolute_time())
+
+#define GPS_UART UART_INSTANCE(BOB_GPS_UART)
+#define GPS_IRQ  (BOB_GPS_UART ? UART1_IRQ : UART0_IRQ)
+
+// The receiver's power on default. That is about 960 bytes/s, which is
+// its default 1 Hz of sentences with room to spare, but not 10 Hz: GGA and
+// RMC alone are about 1.4 kB/s then. Going faster means setting the
+// receiver's baud and rate first (its own commands, saved to its flash),
+// then GPS_BAUD to match.
+#define GPS_BAUD 9600
+
+// Bytes buffered between the IRQ and the task. A power of 2. The task only
+// runs once a whole sentence is in, so this is the longest sentence plus
+// about 180 ms of TL_LOW being held up at GPS_BAUD.
+#define GPS_RING 256
+
+// Externs
+extern gps_t gpsData;
+
+static taskList_t * list = NULL;
+
+// Written by the IRQ only
+static uint8_t rxBuf[GPS_RING];
+static volatile uint32_t rxHead = 0;
+static volatile bool queued = false;
+static uint32_t dropped = 0;
+
+// Written by the task only
+static volatile uint32_t rxTail = 0;
+static char line[NMEA_MAX_LENGTH + 1];
+static uint8_t lineLen = 0;
+static bool inLine = false;
+static uint32_t bad = 0;
+
+/* ---------------------- HELPERS ----------------------- */
+
+/* Decodes a whole sentence, if it is one we want */
+static void gpsSentence(const char * s) {
+    switch(nmeaId(s)) {
+    case NMEA_GGA:
+        if(!nmeaGga(&gpsData, s)) {
+            bad++;
+            break;
+        }
+        gpsData.time = NOW_MS;
+        fPush((uint8_t *) &gpsData, sizeof(gps_t), GPS);
+        break;
+    case NMEA_RMC:
+        // Only fills in between GGAs; it has no satellite count to log.
+        if(!nmeaRmc(&gpsData, s)) {
+            bad++;
+            break;
+        }
+        gpsData.time = NOW_MS;
+        break;
+    case NMEA_INVALID:
+        bad++;
+        break;
+    default:
+        break;
+    }
+}
+
+/* ----------------------- TASKS ------------------------  */
+
+/* Assembles bytes from the ring into sentences. Stops after each whole
+ * sentence and comes back later for the rest. */
+static void gpsTask(void * data) {
+    char c;
+
+    // Clear first, so a byte arriving from here on queues us again
+    queued = false;
+
+    while(rxTail != rxHead) {
+        c = rxBuf[rxTail++ % GPS_RING];
+
+        if(c == '$') {
+            inLine = true;
+            lineLen = 0;
+        }
+        if(!inLine)
+            continue;
+
+        // Too long to be NMEA. Wait for the next $.
+        if(lineLen >= NMEA_MAX_LENGTH) {
+            inLine = false;
+            bad++;
+            continue;
+        }
+
+        line[lineLen++] = c;
+        if(c == '\n') {
+            line[lineLen] = '\0';
+            inLine = false;
+            gpsSentence(line);
+
+            if(rxTail != rxHead && !queued) {
+                queued = true;
+                tlAddPrio(list, TL_LOW, gpsTask, NULL);
+            }
+            return;
+        }
+    }
+}
+
+/* ----------------------- IRQs ------------------------  */
+
+/* Empties the UART FIFO into the ring, and wakes the task at the end of a
+ * sentence */
+static void gpsIRQ(void) {
+    uint8_t c;
+    bool eol = false;
+
+    while(uart_is_readable(GPS_UART)) {
+        c = uart_getc(GPS_UART);
+        if(rxHead - rxTail >= GPS_RING) {
+            dropped++;
+            continue;
+        }
+        rxBuf[rxHead % GPS_RING] = c;
+        rxHead++;
+        eol |= c == '\n';
+    }
+
+    if(eol && !queued) {
+        queued = true;
+        tlAddPrio(list, TL_LOW, gpsTask, NULL);
+    }
+}
+
+/* ------------------ PUBLIC FUNCTIONS ------------------ */
+
+/* Starts listening to the GPS */
+void gpsInit(taskList_t * tl) {
+    list = tl;
+
+    uart_init(GPS_UART, GPS_BAUD);
+    gpio_set_function(BOB_GPS_TX, GPIO_FUNC_UART);
+    gpio_set_function(BOB_GPS_RX, GPIO_FUNC_UART);
+    uart_set_fifo_enabled(GPS_UART, true);
+
+    irq_set_exclusive_handler(GPS_IRQ, gpsIRQ);
+    irq_set_enabled(GPS_IRQ, true);
+    uart_set_irq_enables(GPS_UART, true, false);
+}
+
+/* Returns the number of bytes lost because the ring was full */
+uint32_t gpsDropped(void) {
+    return dropped;
+}
+
+/* Returns the number of sentences that failed to parse or checksum */
+uint32_t gpsBad(void) {
+    return bad;
+}
@@ -0,0 +1,198 @@
+#include "i2cQueue.h"
+
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+
+// Depth of the I2C block's TX and RX FIFOs
+#define IQ_FIFO_DEPTH 16
+
+static i2c_inst_t * bus = NULL;
+static taskList_t * list = NULL;
+
+// Same layout as the task list; head is the last added, tail the last taken.
+static iq_txn_t * queue[IQ_SIZE];
+static uint8_t head = 0;
+static uint8_t tail = 0;
+
+// The transaction on the bus, and how far through it we are
+static iq_txn_t * volatile current = NULL;
+static uint16_t cmdIdx = 0;     // Commands pushed into the TX FIFO
+static uint16_t rxIdx  = 0;     // Bytes read back
+
+/* ---------------------- HELPERS ----------------------- */
+
+/* Moves data between the transaction and the FIFOs, then only enables the
+ * interrupts for whatever is left to do. */
+static void iqFeed(void) {
+    i2c_hw_t * hw = i2c_get_hw(bus);
+    iq_txn_t * t = current;
+    uint16_t total = t->txLen + t->rxLen;
+    uint32_t cmd, mask;
+
+    // Collect anything that has come in
+    while(hw->rxflr && rxIdx < t->rxLen) {
+        t->rx[rxIdx++] = hw->data_cmd;
+    }
+
+    // Queue up as many commands as the FIFOs will take
+    while(cmdIdx < total && hw->txflr < IQ_FIFO_DEPTH) {
+        if(cmdIdx < t->txLen) {
+            cmd = t->tx[cmdIdx];
+        } else {
+            // Dont ask for more bytes than the RX FIFO has room for
+            if(cmdIdx - t->txLen - rxIdx >= IQ_FIFO_DEPTH)
+                break;
+
+            cmd = I2C_IC_DATA_CMD_CMD_BITS;
+            if(cmdIdx == t->txLen && t->txLen)
+                cmd |= I2C_IC_DATA_CMD_RESTART_BITS;
+        }
+
+        if(cmdIdx == total - 1)
+            cmd |= I2C_IC_DATA_CMD_STOP_BITS;
+
+        hw->data_cmd = cmd;
+        cmdIdx++;
+    }
+
+    mask = I2C_IC_INTR_MASK_M_TX_ABRT_BITS | I2C_IC_INTR_MASK_M_STOP_DET_BITS;
+    if(cmdIdx < total)
+        mask |= I2C_IC_INTR_MASK_M_TX_EMPTY_BITS;
+    if(rxIdx < t->rxLen)
+        mask |= I2C_IC_INTR_MASK_M_RX_FULL_BITS;
+    hw->intr_mask = mask;
+}
+
+/* Puts the next transaction on the bus, if there is one.
+ * Must be called with interrupts disabled. */
+static void iqStart(void) {
+    i2c_hw_t * hw = i2c_get_hw(bus);
+
+    if(head == tail) {
+        current = NULL;
+        hw->intr_mask = 0;
+        return;
+    }
+
+    tail = (tail + 1) % IQ_SIZE;
+    current = queue[tail];
+    cmdIdx = 0;
+    rxIdx = 0;
+
+    // The target address can only be changed while the block is disabled
+    hw->enable = 0;
+    hw->tar = current->addr;
+    hw->enable = 1;
+
+    iqFeed();
+}
+
+/* ----------------------- IRQs ------------------------  */
+
+static void iqIRQ(void) {
+    i2c_hw_t * hw = i2c_get_hw(bus);
+    uint32_t stat = hw->intr_stat;
+    iq_txn_t * t = current;
+
+    if(t == NULL) {
+        hw->intr_mask = 0;
+        return;
+    }
+
+    if(stat & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+        // NACK or lost arbitration. The block sends a stop for us.
+        t->status = IQ_ERROR;
+        (void) hw->clr_tx_abrt;
+    }
+
+    if(stat & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
+        (void) hw->clr_stop_det;
+
+        while(hw->rxflr && rxIdx < t->rxLen) {
+            t->rx[rxIdx++] = hw->data_cmd;
+        }
+
+        t->doneUs = time_us_32();
+        if(t->status == IQ_BUSY)
+            t->status = rxIdx == t->rxLen ? IQ_OK : IQ_ERROR;
+
+        if(t->callback)
+            tlAddPrio(list, TL_HIGH, t->callback, t);
+
+        iqStart();
+        return;
+    }
+
+    if(t->status == IQ_BUSY)
+        iqFeed();
+}
+
+/* ------------------ PUBLIC FUNCTIONS ------------------ */
+
+/* Hands the bus over to the queue. */
+void iqInit(i2c_inst_t * i2c, taskList_t * tl) {
+    i2c_hw_t * hw = i2c_get_hw(i2c);
+    uint irq = I2C0_IRQ + i2c_hw_index(i2c);
+
+    bus = i2c;
+    list = tl;
+
+    hw->intr_mask = 0;
+    hw->rx_tl = 0;      // Interrupt as soon as a byte comes in
+    hw->tx_tl = 2;      // Top up the TX FIFO before it runs dry
+
+    irq_set_exclusive_handler(irq, iqIRQ);
+    irq_set_enabled(irq, true);
+}
+
+/* Fills in a transaction. Buffers must outlive the transaction. */
+void iqSetup(iq_txn_t * txn, uint8_t addr,
+             const uint8_t * tx, uint8_t txLen,
+             uint8_t * rx, uint8_t rxLen,
+             void (*callback) (void * )) {
+    txn->addr = addr;
+    txn->tx = tx;
+    txn->txLen = txLen;
+    txn->rx = rx;
+    txn->rxLen = rxLen;
+    txn->callback = callback;
+    txn->status = IQ_OK;
+}
+
+/* Queues a transaction.
+ * Returns:
+ * 0 on success
+ * 1 if the queue is full or txn is already queued */
+uint8_t iqSubmit(iq_txn_t * txn) {
+    uint8_t nextHead = (head + 1) % IQ_SIZE;
+
+    int ints = save_and_disable_interrupts();
+    if(nextHead == tail || txn->status == IQ_BUSY
+    || txn->txLen + txn->rxLen == 0) {
+        restore_interrupts(ints);
+        return 1;
+    }
+
+    txn->status = IQ_BUSY;
+    head = nextHead;
+    queue[head] = txn;
+
+    if(current == NULL)
+        iqStart();
+
+    restore_interrupts(ints);
+    return 0;
+}
+
+/* Returns true if nothing is queued or running */
+bool iqIdle(void) {
+    return current == NULL;
+}
+
+/* Waits for everything queued to finish */
+void iqFlush(void) {
+    while(!iqIdle()) {
+        tight_loop_contents();
+    }
+}
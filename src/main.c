@@ -1,15 +1,25 @@
 #include "pico/stdlib.h"
 #include "stdio.h"
 
+#ifdef BOB_DUAL_CORE
+#include "pico/multicore.h"
+#endif
+
 #include "ansi.h"
 #include "sampler.h"
+#include "detect.h"
 #include "taskList.h"
 #include "types.h"
 #include "hat.h"
 #include "flash.h"
 #include "shell.h"
+#include "telemetry.h"
+#include "gps.h"
+#include "trace.h"
 
-enum states state = FAULT_HANDLER;
+// Driven by the detector, see detect.h. Nothing is written to flash until
+// launch.
+enum states state = BOOT;
 
 // Latest data packets from the sensors.
 // Made global for other tasks to have access to them
@@ -19,20 +29,66 @@ imu_t  imuData = {0};
 comp_t compData = {0};
 gps_t gpsData = {0};
 
+// Flight profile and deployment settings, loaded from flash at boot
+conf_t config = {0};
+
 // Task list
 taskList_t tl;
 
+#ifdef BOB_DUAL_CORE
+/* With BOB_DUAL_CORE, core 1 does all the sampling and filtering while core
+ * 0 writes to flash and runs the shell. Each core runs its own task list, so
+ * neither has to lock the other out of it; the sample ring is the only thing
+ * passing data between them. */
+taskList_t sensorList;
+taskList_t * sensorTl = &sensorList;
+
+static void core1Main(void) {
+    // Let core 0 park us while it writes to flash
+    multicore_lockout_victim_init();
+
+    configureSensors(&config, sensorTl);
+    gpsInit(sensorTl);
+
+    while (true) {
+        traceDepth(TQ_SENSOR, tlSize(sensorTl));
+        if(tlRun(sensorTl))
+            tlIdle(sensorTl);
+    }
+}
+#else
+taskList_t * sensorTl = &tl;
+#endif
+
 int main() {
     stdio_init_all();
 
     tl = tlInit();
 
-    configureSensors();
+    // Fall back to the default profile if nothing has been saved
+    if(fLoadConfig(&config)) {
+        sensorProfile(0, &config);
+    }
+    detectInit(&config);
+
+#ifndef BOB_DUAL_CORE
+    configureSensors(&config, sensorTl);
+    gpsInit(sensorTl);
+#endif
     hatInit();
     shellInit();
-    fInit();
+    fInit(&config);
+    telemInit(&tl);
+
+#ifdef BOB_DUAL_CORE
+    // Only start sampling once the ring is ready for it
+    *sensorTl = tlInit();
+    multicore_launch_core1(core1Main);
+#endif
 
     while (true) {
-        tlRun(&tl);
+        traceDepth(TQ_MAIN, tlSize(&tl));
+        if(tlRun(&tl))
+            tlIdle(&tl);
     }
 }
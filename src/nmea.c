@@ -0,0 +1,239 @@
+#include "nmea.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Digits of fraction kept from minutes. 1e-5 minutes is under 2 cm.
+#define NMEA_FRAC 5
+
+/* ---------------------- HELPERS ----------------------- */
+
+static inline bool nmeaIsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool nmeaIsEnd(char c) {
+    return c == ',' || c == '*';
+}
+
+static int8_t nmeaHex(char c) {
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/* Moves p past the comma at the end of the current field.
+ * Returns false if there are no more fields. */
+static bool nmeaNext(const char ** p) {
+    while(!nmeaIsEnd(**p))
+        (*p)++;
+
+    if(**p != ',')
+        return false;
+    (*p)++;
+    return true;
+}
+
+/* Reads exactly n digits */
+static bool nmeaFixed(const char ** p, uint8_t n, uint32_t * out) {
+    uint32_t v = 0;
+
+    while(n--) {
+        if(!nmeaIsDigit(**p))
+            return false;
+        v = v * 10 + *(*p)++ - '0';
+    }
+
+    *out = v;
+    return true;
+}
+
+/* Reads an unsigned integer field. Empty reads as 0. */
+static bool nmeaUint(const char ** p, uint32_t * out) {
+    uint32_t v = 0;
+    uint8_t n = 0;
+
+    while(nmeaIsDigit(**p) && n++ < 9)
+        v = v * 10 + *(*p)++ - '0';
+
+    *out = v;
+    return nmeaIsEnd(**p);
+}
+
+/* Reads a time field, hhmmss with optional fractional seconds. utc is
+ * left alone if it is empty. */
+static bool nmeaTime(const char ** p, uint8_t utc[3]) {
+    uint32_t h, m, s;
+
+    if(nmeaIsEnd(**p))
+        return true;
+
+    if(!nmeaFixed(p, 2, &h) || !nmeaFixed(p, 2, &m) || !nmeaFixed(p, 2, &s))
+        return false;
+    if(h > 23 || m > 59 || s > 60)
+        return false;
+
+    if(**p == '.') {
+        (*p)++;
+        while(nmeaIsDigit(**p))
+            (*p)++;
+    }
+    if(!nmeaIsEnd(**p))
+        return false;
+
+    utc[0] = h;
+    utc[1] = m;
+    utc[2] = s;
+    return true;
+}
+
+/* Reads a coordinate and its hemisphere, as two fields. deg is the number
+ * of digits of whole degrees, i.e. 2 for latitude, 3 for longitude, and neg
+ * is the hemisphere letter that makes it negative.
+ * Returns false if it is malformed. present says if there was one at all. */
+static bool nmeaCoord(const char ** p, uint8_t deg, char neg,
+                      int32_t * out, bool * present) {
+    uint32_t d, m, frac = 0;
+    uint8_t n = 0;
+    int32_t v;
+
+    *present = false;
+    if(nmeaIsEnd(**p))
+        return nmeaNext(p);
+
+    if(!nmeaFixed(p, deg, &d) || !nmeaFixed(p, 2, &m) || m > 59)
+        return false;
+    if(d > (deg == 2 ? 90 : 180))
+        return false;
+
+    // Minutes to NMEA_FRAC places, padded or truncated
+    if(**p == '.') {
+        (*p)++;
+        while(nmeaIsDigit(**p)) {
+            if(n < NMEA_FRAC) {
+                frac = frac * 10 + **p - '0';
+                n++;
+            }
+            (*p)++;
+        }
+    }
+    while(n++ < NMEA_FRAC)
+        frac *= 10;
+
+    // 1e-5 minutes to 1e-7 degrees is * 100 / 60
+    v = d * 10000000 + (m * 100000 + frac) * 5 / 3;
+
+    if(!nmeaNext(p))
+        return false;
+    if(**p == neg)
+        v = -v;
+    else if(!nmeaIsEnd(**p) && **p != (neg == 'S' ? 'N' : 'E'))
+        return false;
+
+    *out = v;
+    *present = true;
+    return true;
+}
+
+/* ------------------ PUBLIC FUNCTIONS ------------------ */
+
+/* Checks a sentence's checksum and works out what it is */
+enum nmeaSentence nmeaId(const char * s) {
+    const char * p = s + 1;
+    uint8_t sum = 0;
+    int8_t hi, lo;
+
+    if(*s != '$')
+        return NMEA_INVALID;
+
+    // XOR of everything between the $ and the *, which must be printable
+    while(*p >= ' ' && *p <= '~' && *p != '*')
+        sum ^= *p++;
+
+    if(*p++ != '*')
+        return NMEA_INVALID;
+    hi = nmeaHex(*p++);
+    if(hi < 0)
+        return NMEA_INVALID;
+    lo = nmeaHex(*p++);
+    if(lo < 0 || sum != (hi << 4 | lo))
+        return NMEA_INVALID;
+
+    // Only a newline is allowed after
+    while(*p == '\r' || *p == '\n')
+        p++;
+    if(*p)
+        return NMEA_INVALID;
+
+    // Two letters of talker, then three of type. The checksum passed, so
+    // the string is long enough to look at.
+    if(s[1] == '*' || s[2] == '*' || s[3] == '*' || s[4] == '*'
+    || s[5] == '*' || s[6] != ',')
+        return NMEA_UNKNOWN;
+    if(s[3] == 'G' && s[4] == 'G' && s[5] == 'A')
+        return NMEA_GGA;
+    if(s[3] == 'R' && s[4] == 'M' && s[5] == 'C')
+        return NMEA_RMC;
+    return NMEA_UNKNOWN;
+}
+
+/* Decodes a GGA into gps.
+ * $--GGA,hhmmss.ss,ddmm.mm,a,dddmm.mm,a,q,ss,... */
+bool nmeaGga(gps_t * gps, const char * s) {
+    const char * p = s + 7;
+    uint8_t utc[3] = {gps->utc[0], gps->utc[1], gps->utc[2]};
+    int32_t lat, lon;
+    uint32_t fix, sats;
+    bool hasLat, hasLon;
+
+    // gps_t is packed, so everything goes through locals
+    if(!nmeaTime(&p, utc) || !nmeaNext(&p))
+        return false;
+    if(!nmeaCoord(&p, 2, 'S', &lat, &hasLat) || !nmeaNext(&p))
+        return false;
+    if(!nmeaCoord(&p, 3, 'W', &lon, &hasLon) || !nmeaNext(&p))
+        return false;
+    if(!nmeaUint(&p, &fix) || !nmeaNext(&p))
+        return false;
+    if(!nmeaUint(&p, &sats))
+        return false;
+
+    memcpy(gps->utc, utc, sizeof(utc));
+    gps->sats = sats;
+    if(fix && hasLat && hasLon) {
+        gps->lat = lat;
+        gps->lon = lon;
+    }
+    return true;
+}
+
+/* Decodes an RMC into gps.
+ * $--RMC,hhmmss.ss,A,ddmm.mm,a,dddmm.mm,a,... */
+bool nmeaRmc(gps_t * gps, const char * s) {
+    const char * p = s + 7;
+    uint8_t utc[3] = {gps->utc[0], gps->utc[1], gps->utc[2]};
+    int32_t lat, lon;
+    bool valid, hasLat, hasLon;
+
+    if(!nmeaTime(&p, utc) || !nmeaNext(&p))
+        return false;
+    valid = *p == 'A';
+    if(!nmeaNext(&p))
+        return false;
+    if(!nmeaCoord(&p, 2, 'S', &lat, &hasLat) || !nmeaNext(&p))
+        return false;
+    if(!nmeaCoord(&p, 3, 'W', &lon, &hasLon))
+        return false;
+
+    if(valid && hasLat && hasLon) {
+        memcpy(gps->utc, utc, sizeof(utc));
+        gps->lat = lat;
+        gps->lon = lon;
+    }
+    return true;
+}
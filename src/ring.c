@@ -0,0 +1,89 @@
+#include "ring.h"
+
+#include <stddef.h>
+
+/* head and tail are the only things shared between the two sides. Each side
+ * only ever writes its own index, and publishes it with a release store so
+ * the other side (acquiring it) is guaranteed to see the data behind it.
+ * On the M0+ these compile down to a plain load/store and a DMB. */
+#define LOAD_ACQ(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE_REL(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+/* Initialises a ring using size bytes of buf as storage */
+void ringInit(ring_t * ring, uint8_t * buf, uint32_t size) {
+    ring->buf         = buf;
+    ring->size        = size;
+    ring->head        = 0;
+    ring->tail        = 0;
+    ring->wrap        = 0;
+    ring->dropped     = 0;
+    ring->wrapPending = false;
+}
+
+/* Reserves len contiguous bytes for the producer to write into.
+ * head is never allowed to catch up with tail, as that would look empty. */
+uint8_t * ringReserve(ring_t * ring, uint32_t len) {
+    uint32_t h = ring->head;
+    uint32_t t = LOAD_ACQ(&ring->tail);
+
+    if(h >= t) {
+        // Free space runs from head to the end, then from the start to tail
+        if(h + len < ring->size) {
+            ring->wrapPending = false;
+            return ring->buf + h;
+        } else if(len < t) {
+            ring->wrapPending = true;
+            return ring->buf;
+        }
+    } else if(h + len < t) {
+        // We've already wrapped, free space runs from head to tail
+        ring->wrapPending = false;
+        return ring->buf + h;
+    }
+
+    ring->dropped++;
+    return NULL;
+}
+
+/* Publishes the last reservation to the consumer. */
+void ringCommit(ring_t * ring, uint32_t len) {
+    if(ring->wrapPending) {
+        // Tell the consumer where the data stops before going back round.
+        ring->wrap = ring->head;
+        STORE_REL(&ring->head, len);
+    } else {
+        STORE_REL(&ring->head, ring->head + len);
+    }
+}
+
+/* Gets the oldest data in the ring without removing it. */
+uint8_t * ringPeek(ring_t * ring, uint32_t * len) {
+    uint32_t h = LOAD_ACQ(&ring->head);
+    uint32_t t = ring->tail;
+
+    // If the producer wrapped and we've read everything before the gap,
+    // follow it back to the start.
+    if(h < t && t == ring->wrap) {
+        t = 0;
+        STORE_REL(&ring->tail, 0);
+    }
+
+    if(h == t)
+        return NULL;
+
+    *len = h > t ? h - t : ring->wrap - t;
+    return ring->buf + t;
+}
+
+/* Frees len bytes from the tail of the ring. */
+void ringRelease(ring_t * ring, uint32_t len) {
+    STORE_REL(&ring->tail, ring->tail + len);
+}
+
+/* Returns the number of bytes waiting in the ring */
+uint32_t ringUsed(ring_t * ring) {
+    uint32_t h = LOAD_ACQ(&ring->head);
+    uint32_t t = ring->tail;
+
+    return h >= t ? h - t : ring->wrap - t + h;
+}
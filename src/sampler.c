@@ -3,9 +3,15 @@
 #include "qmc5883l.h"
 #include "qmi8658c.h"
 #include "ansi.h"
+#include "calib.h"
+#include "i2cQueue.h"
 #include "taskList.h"
 #include "types.h"
 #include "flash.h"
+#include "filter.h"
+#include "detect.h"
+#include "estimator.h"
+#include "trace.h"
 
 #include <pico/stdlib.h>
 #include <stdlib.h>
@@ -16,16 +22,98 @@
 
 // Helper functions
 #define NOW_MS to_ms_since_boot(get_absolute_time())
-
-// Flash config
-#define PROG_RESERVED (1024 * 1024)
+#define NOW_US time_us_32()
+// For sample times, which have to keep going past the 32 bit us wrap to
+// stay in step with NOW_MS. NOW_US is fine for differences.
+#define NOW_US64 time_us_64()
 
 // Sensor config
 #define GYRO_RANGE QMI_GYRO_256DPS
 #define ACCL_RANGE QMI_ACC_16G
-
-// State config
-#define BOOT_TIME_MS 1000 // How long do we wait for the filters to filter
+#define COMP_RANGE QMC_SCALE_2G
+
+// Size of a count in the logged units, in Q(CAL_Q), worked out at compile
+// time for the ranges above. The QMI's full scale is 2^(range + 1) g and
+// 2^(range + 4) dps, and the QMC reads 12000 per gauss at 2 G, 3000 at 8 G.
+#define ACCL_UNITS ((int32_t) ((98066LL << (ACCL_RANGE + 1 + CAL_Q)) / 100 / 32768))
+#define GYRO_UNITS ((int32_t) ((100LL << (GYRO_RANGE + 4 + CAL_Q)) / 32768))
+#define COMP_UNITS ((int32_t) ((10000LL << CAL_Q) / (COMP_RANGE ? 3000 : 12000)))
+
+// The QMI samples into its FIFO at the profile's ODR, and we empty it once
+// about half of IMU_BATCH has built up, so a late task can catch up.
+#define IMU_BATCH     16
+#define QMI_MAX_WAITS 5     // Periods before a stuck FIFO read is abandoned
+
+// HP203 measurement settings. The baro filter is designed for 20 Hz, so
+// only the OSR is part of the profile.
+#define HP_CHANNEL   HP203_PRES_TEMP
+#define HP_PERIOD_MS 50
+
+// While BOOT or GROUNDED the gyro snoozes, the compass is on standby and
+// the HP203 measures at PAD_BARO_OSR, so a long hold on the pad doesnt
+// flatten the battery. Launch is detected off the accelerometer, which
+// always runs at full rate, and everything is woken straight after.
+#define PAD_BARO_OSR HP203_OSR_256
+
+// Hardware alarm and timer slots for the sampler's own alarm pool, only used
+// when the sensors are run from core 1. Core 0's default pool uses alarm 3.
+#define SAMPLER_ALARM  2
+#define SAMPLER_TIMERS 8
+
+// Built in flight profiles. Only the sensor settings are used from these.
+static const conf_t profiles[N_PROFILES] = {
+    // Default. Slow bus, moderate rates.
+    {.profile = 0, .i2cKhz = 100, .imuOdr = QMI_ACC_250HZ,
+     .compOdr = QMC_ODR_100HZ, .compOsr = QMC_OSR_256, .baroOsr = HP203_OSR_1024},
+    // Fast mode I2C.
+    {.profile = 1, .i2cKhz = 400, .imuOdr = QMI_ACC_500HZ,
+     .compOdr = QMC_ODR_200HZ, .compOsr = QMC_OSR_128, .baroOsr = HP203_OSR_512},
+    // Fast mode plus. Outside the HP203 and QMC's rated bus speed, so check
+    // it actually works on the board before flying it.
+    {.profile = 2, .i2cKhz = 1000, .imuOdr = QMI_ACC_1KHZ,
+     .compOdr = QMC_ODR_200HZ, .compOsr = QMC_OSR_64, .baroOsr = HP203_OSR_256}
+};
+
+// Compass period in ms for each enum QMCODR
+static const uint8_t qmcPeriods[4] = {100, 20, 10, 5};
+
+/* Filters. See filter.h for what the numbers mean. */
+
+// Andy's filter for k = 4, f = 20. A band pass on pressure that gives
+// (arbitrary units of) vertical velocity, designed for HP_PERIOD_MS.
+// The gain is 16 times the original, which only read 1 for a 20 m/s climb.
+static const biquad_t baroVelFilter = {.b = {160, 0, -160}, .a = {-112, 49},
+                                       .shift = 8};
+
+// acclFilt averages the last 2^ACCL_AVG magnitudes
+#define ACCL_AVG 3
+
+/* How much of each sensor gets logged in each state, as the number of
+ * samples read for every one logged. Once off the pad the sensors always
+ * run flat out, so the filters see everything and changing rate never
+ * leaves a gap; only what goes into the log changes. */
+typedef struct {
+    uint8_t imu;
+    uint8_t comp;
+    uint8_t baro;
+} rate_t;
+
+// On the pad only the pre-trigger window reaches flash, so the IMU is kept
+// fine enough to catch ignition at the cost of a shorter window.
+static const rate_t rateLow   = {2,  10, 4};  // Sat on the pad
+static const rate_t rateMax   = {1,  1,  1};  // Anything could happen
+static const rate_t rateDecim = {4,  4,  2};  // Drifting down under the main
+
+// Samples read since the last one of each was logged
+static uint8_t imuSkip, compSkip, baroSkip;
+
+// Calibration tables, built from the config
+static calTable_t acclCal, gyroCal, compCal;
+
+// Filter state
+static biquadState_t baroVel;
+static movAvg_t acclAvg;
+static int32_t acclBuf[1 << ACCL_AVG];
 
 // Sensor structs
 static hp203_t hp203;
@@ -37,8 +125,53 @@ static repeating_timer_t qmiTimer;
 static repeating_timer_t hpStartTimer;
 static repeating_timer_t hpEndTimer;
 
+// Timers and tasks run on whichever core configured the sensors
+static alarm_pool_t * pool = NULL;
+static taskList_t * list = NULL;
+
+// Settings taken from the profile
+static uint32_t imuOdrUs;
+static enum HP203_OSR hpOsr;       // In use right now
+static enum HP203_OSR flightOsr;   // Once off the pad
+
+/* I2C transactions and their buffers. These need to outlive the tasks that
+ * queue them, so they all live here. */
+static iq_txn_t hpStartTxn, hpEndTxn, qmcTxn;
+static uint8_t hpStartCmd;
+static const uint8_t hpEndCmd = HP203_READ_PT;
+static uint8_t hpBuf[6];
+static const uint8_t qmcReg = QMC_XOUT_LSB;
+static uint8_t qmcBuf[6];
+
+/* Reading the QMI's FIFO takes a few steps, see QMIFifoRead. Each callback
+ * queues the next lot of transactions. */
+static iq_txn_t qmiReqTxn, qmiPollTxn, qmiAckTxn, qmiCountTxn, qmiTsTxn,
+                qmiDataTxn, qmiDoneTxn;
+static const uint8_t qmiReqCmd[2]  = {QMI_CTRL_CMD, QMI_CMD_REQ_FIFO};
+static const uint8_t qmiAckCmd[2]  = {QMI_CTRL_CMD, QMI_CMD_ACK};
+static const uint8_t qmiStatusReg  = QMI_STATUSINT;
+static const uint8_t qmiCountReg   = QMI_FIFO_SMPL_CNT;
+static const uint8_t qmiTsReg      = QMI_TIMESTAMP_LSB;
+static const uint8_t qmiDataReg    = QMI_FIFO_DATA;
+static uint8_t qmiDoneCmd[2]       = {QMI_FIFO_CTRL, 0};
+static uint8_t qmiWakeCmd[2]       = {QMI_CTRL_ENB, 0};
+static uint8_t qmcWakeCmd[2]       = {QMC_CONTROL1, 0};
+static iq_txn_t qmiWakeTxn, qmcWakeTxn;
+static bool onPad = true;      // Are the sensors in their pad power modes?
+static uint8_t qmiStatus, qmiCount[2], qmiTs[3];
+static uint8_t qmiFifo[IMU_BATCH * QMI_FIFO_FRAME];
+static bool qmiBusy = false;
+static uint8_t qmiPolls;
+static uint8_t qmiWaits;       // Periods the current read has been going for
+static uint64_t qmiReadUs;     // When the newest sample was read
+
+// The IMU timer's period, and ticks it has missed because its IRQ was held
+// off. Only ever written from its IRQ.
+static uint32_t qmiPeriodUs;
+static uint32_t qmiTickUs;
+static volatile uint32_t qmiMissed = 0;
+
 // Externs
-extern taskList_t tl;
 extern enum states state;
 
 extern baro_t baroData;
@@ -48,118 +181,350 @@ extern comp_t compData;
 /* ------------------------- IRQs ------------------------- */
 
 static bool addRepeat(repeating_timer_t *rt) {
-    tlAdd(&tl, rt->user_data, NULL);
+    tlAddPrio(list, TL_HIGH, rt->user_data, NULL);
     return true;
 }
 
 static bool addOnce(repeating_timer_t *rt) {
-    tlAdd(&tl, rt->user_data, NULL);
+    tlAddPrio(list, TL_HIGH, rt->user_data, NULL);
+    return false;
+}
+
+/* As addRepeat, but keeps count of the ticks that never came */
+static bool qmiIRQ(repeating_timer_t *rt) {
+    uint32_t now = NOW_US;
+
+    if(qmiTickUs)
+        qmiMissed += (now - qmiTickUs + qmiPeriodUs / 2) / qmiPeriodUs - 1;
+    qmiTickUs = now;
+
+    tlAddPrio(list, TL_HIGH, rt->user_data, NULL);
+    return true;
+}
+
+/* ------------------------ RATES ------------------------- */
+
+/* Returns the logging rates for a state */
+static const rate_t * stateRate(enum states s) {
+    switch(s) {
+    case BOOT:
+    case GROUNDED:
+        return &rateLow;
+    case MAIN_OUT:
+    case LANDED:
+        return &rateDecim;
+    default:
+        // Boost through to main deployment, and anything we dont expect
+        return &rateMax;
+    }
+}
+
+/* Counts a sample towards the next one to log.
+ * Returns true if this one should be logged. */
+static bool logDue(uint8_t * skip, uint8_t every) {
+    if(++*skip >= every) {
+        *skip = 0;
+        return true;
+    }
     return false;
 }
 
 /* ------------------- DATA PROCESSING -------------------- */
 
-/* Filters the barometer data */
+/* Filters the barometer data, and corrects the altitude estimate */
 static baro_t baroProcessor(struct hp203_data raw) {
-    static int32_t dn0, dn1, dn2, bn0, bn1, bn2 = 0;
     baro_t out = {0};
 
-    bn0 = raw.pres;
-
-    // Apply andy's filter for k = 4, f = 20,
-    dn0 = (10*bn0 - 10*bn2 + 112*dn1 - 49*dn2) >> 8;
-    dn1 = dn0; dn2 = dn1; bn1 = raw.pres; bn2 = bn1;
-
+    estBaro(raw.pres, onPad);
     out.pres = raw.pres;
-    out.vVel = dn0;
+    out.vVel = biquadStep(&baroVelFilter, &baroVel, raw.pres);
     out.temp = raw.temp;
     out.time = NOW_MS;
 
     return out;
 }
 
-/* Calculates the magnitude of the accelerometer data  */
-static imu_t imuProcessor(struct qmi_data raw) {
-    static int32_t bn0;
+/* Calibrates the IMU data, calculates the magnitude of the acceleration and
+ * steps the estimator on */
+static imu_t imuProcessor(struct qmi_data raw, uint32_t time) {
     imu_t out = {0};
+    int16_t accl[3], gyro[3];
 
-    out.time = NOW_MS;
-    memcpy(out.accl, raw.accel, 6);
-    memcpy(out.gyro, raw.gyro, 6);
+    // imu_t is packed, so go through aligned copies
+    calApply(&acclCal, raw.accel, accl);
+    calApply(&gyroCal, raw.gyro, gyro);
+    estImu(accl, gyro);
+
+    out.time = time;
+    memcpy(out.accl, accl, 6);
+    memcpy(out.gyro, gyro, 6);
 
     // Really scuff manhattan magnitude.
-    int32_t acclMag = abs(out.accl[0]) + abs(out.accl[1]) + abs(out.accl[2]);
-    out.acclFilt = acclMag + 5 * bn0;
+    int32_t acclMag = abs(accl[0]) + abs(accl[1]) + abs(accl[2]);
+    out.acclFilt = maStep(&acclAvg, acclMag);
 
     return out;
 }
 
-/* This... doesnt do much. Eh. */
+/* Calibrates the compass data, and corrects the estimator's yaw */
 static comp_t compProcessor(int16_t * raw) {
     comp_t out = {0};
+    int16_t mag[3];
 
-    memcpy(out.compass, raw, 6);
+    calApply(&compCal, raw, mag);
+    estComp(mag);
+    memcpy(out.compass, mag, 6);
     out.time = NOW_MS;
 
     return out;
 }
 
+/* ------------------------- POWER ------------------------ */
+
+/* Brings the sensors out of their pad power modes once launch has been
+ * detected. The writes go out on the queue behind whatever is already on
+ * it. A start command that has already been queued at the pad OSR is just
+ * waited on for longer, so the next baro reading never comes up short. */
+static void padWake(void) {
+    if(!onPad || state == BOOT || state == GROUNDED)
+        return;
+
+    onPad = false;
+    iqSubmit(&qmiWakeTxn);
+    iqSubmit(&qmcWakeTxn);
+    hpOsr = flightOsr;
+    hpStartCmd = HP203MeasureCmd(HP_CHANNEL, hpOsr);
+}
+
 /* ------------------------- TASKS ------------------------ */
 
-/* Gets data from the HP203. */
-static void hpEndTask(void * data) {
+/* Processes the HP203's data once it has arrived. The estimate is logged
+ * along with it, as thats when its altitude has just been corrected. */
+static void hpEndDone(void * data) {
     struct hp203_data hpRaw;
-    int32_t i2cStatus;
+    est_t est;
+    uint32_t start = traceStart();
+
+    if(hpEndTxn.status == IQ_OK) {
+        HP203ParseData(hpBuf, &hpRaw);
+        baroData = baroProcessor(hpRaw);
+        if(logDue(&baroSkip, stateRate(state)->baro)) {
+            est = estGet(baroData.time);
+            fPush(&baroData, sizeof(baro_t), BARO);
+            fPush(&est, sizeof(est_t), EST);
+        }
+        detectBaro(&baroData, hpEndTxn.doneUs);
+    }
+    traceEnd(TR_HP_DONE, start);
+}
+
+/* Asks the HP203 for its data. */
+static void hpEndTask(void * data) {
+    uint32_t start = traceStart();
 
-    i2cStatus = HP203GetData(&hp203, &hpRaw);
-    baroData = baroProcessor(hpRaw);
-    fPush(&baroData, sizeof(baro_t), BARO);
+    iqSubmit(&hpEndTxn);
+    traceEnd(TR_HP_END, start);
 }
 
-/* Tells the HP203 to start a reading, then sets a timer for
- * when its done */
-static void hpStartTask(void * data) {
+/* The HP203 has started measuring, set a timer for when its done */
+static void hpStartDone(void * data) {
     // Its easier to just use a repeating timer once than an alarm pool.
-    int32_t i2cStatus;
+    if(hpStartTxn.status == IQ_OK) {
+        alarm_pool_add_repeating_timer_us(pool, HP203MeasureTime(HP_CHANNEL, hpOsr),
+                                          addOnce, hpEndTask, &hpEndTimer);
+    }
+}
+
+/* Tells the HP203 to start a reading */
+static void hpStartTask(void * data) {
+    iqSubmit(&hpStartTxn);
+}
+
+/* Processes everything read out of the QMI's FIFO. Each sample is
+ * timestamped using the QMI's sample counter, counting back from when the
+ * newest one in the FIFO was read. That may not be among those read, if
+ * more than IMU_BATCH had built up. */
+static void qmiDone(void * data) {
+    struct qmi_data imu[IMU_BATCH];
+    uint16_t n = qmiDataTxn.rxLen / QMI_FIFO_FRAME;
+    uint32_t ts, age;
+    uint16_t i;
+    uint32_t start = traceStart();
+
+    qmiBusy = false;
+
+    if(qmiDataTxn.status != IQ_OK || qmiCountTxn.status != IQ_OK
+    || qmiTsTxn.status != IQ_OK) {
+        traceEnd(TR_QMI_DONE, start);
+        return;
+    }
+
+    ts = qmiTs[0] | qmiTs[1] << 8 | qmiTs[2] << 16;
+    QMIParseFifo(qmiFifo, n, QMIFifoFrames(qmiCount), ts, imu);
 
-    i2cStatus = HP203Measure(&hp203, HP203_PRES_TEMP, HP203_OSR_1024);
-    if(i2cStatus > HP203_OK) {
-        add_repeating_timer_us(i2cStatus, addOnce, hpEndTask, &hpEndTimer);
+    for(i = 0; i < n; i++) {
+        age = ((ts - imu[i].timestamp) & 0xFFFFFF) * imuOdrUs;
+        imuData = imuProcessor(imu[i], (qmiReadUs - age) / 1000);
+        if(logDue(&imuSkip, stateRate(state)->imu))
+            fPush(&imuData, sizeof(imu_t), IMU);
+        detectImu(&imuData, (uint32_t) qmiReadUs - age);
     }
+    padWake();
+    traceEnd(TR_QMI_DONE, start);
+}
+
+/* We know how much is in the FIFO, read it then hand it back. */
+static void qmiCounted(void * data) {
+    uint16_t n = MIN(QMIFifoFrames(qmiCount), IMU_BATCH);
+
+    qmiDataTxn.rxLen = n * QMI_FIFO_FRAME;
+    if(n && qmiCountTxn.status == IQ_OK)
+        iqSubmit(&qmiDataTxn);
+    iqSubmit(&qmiDoneTxn);
+}
 
+/* Checks if the QMI has handed over its FIFO yet. */
+static void qmiPolled(void * data) {
+    if(qmiPollTxn.status == IQ_OK && qmiStatus & QMI_CMD_DONE) {
+        qmiReadUs = NOW_US64;
+        iqSubmit(&qmiAckTxn);
+        iqSubmit(&qmiCountTxn);
+        iqSubmit(&qmiTsTxn);
+    } else if(++qmiPolls < QMI_CMD_TRIES) {
+        iqSubmit(&qmiPollTxn);
+    } else {
+        // Give up on this one, and make sure the QMI isnt left in read mode
+        qmiDataTxn.rxLen = 0;
+        qmiDataTxn.status = IQ_ERROR;
+        iqSubmit(&qmiAckTxn);
+        iqSubmit(&qmiDoneTxn);
+    }
 }
 
-/* Gets IMU data */
+/* Starts emptying the IMU's FIFO. */
 static void qmiTask(void * data) {
-    struct qmi_data imu;
-    int32_t i2cStatus;
+    struct qmi_data imu[IMU_BATCH];
+    uint64_t now;
+    uint32_t age, ts;
+    int16_t n, i;
+    uint32_t start = traceStart();
+
+    if(qmi.autoInc) {
+        // Dont start another read if the last one is still going, unless
+        // it has clearly gone missing.
+        if(!qmiBusy || ++qmiWaits > QMI_MAX_WAITS) {
+            qmiBusy = true;
+            qmiPolls = 0;
+            qmiWaits = 0;
+            iqSubmit(&qmiReqTxn);
+            iqSubmit(&qmiPollTxn);
+        }
+        traceEnd(TR_QMI_TASK, start);
+        return;
+    }
 
-    i2cStatus = QMIReadData(&qmi, &imu);
-    imuData = imuProcessor(imu);
-    fPush(&imuData, sizeof(imu_t), IMU);
+    // The async reads need burst mode, so do it the slow way.
+    iqFlush();
+    now = NOW_US64;
+    n = QMIFifoRead(&qmi, imu, IMU_BATCH, &ts);
+
+    for(i = 0; i < n; i++) {
+        age = ((ts - imu[i].timestamp) & 0xFFFFFF) * imuOdrUs;
+        imuData = imuProcessor(imu[i], (now - age) / 1000);
+        if(logDue(&imuSkip, stateRate(state)->imu))
+            fPush(&imuData, sizeof(imu_t), IMU);
+        detectImu(&imuData, (uint32_t) now - age);
+    }
+    padWake();
+    traceEnd(TR_QMI_TASK, start);
 }
 
-/* Gets IMU data */
-static void qmcTask(void * data) {
+/* Processes the compass data once it has arrived. */
+static void qmcDone(void * data) {
     int16_t mag[3];
-    int32_t i2cStatus;
 
-    i2cStatus = QMCGetMag(&qmc, mag);
-    compData = compProcessor(mag);
-    fPush(&compData, sizeof(comp_t), COMP);
+    if(qmcTxn.status == IQ_OK) {
+        QMCParseMag(qmcBuf, mag);
+        compData = compProcessor(mag);
+        if(logDue(&compSkip, stateRate(state)->comp))
+            fPush(&compData, sizeof(comp_t), COMP);
+    }
+}
+
+/* Gets compass data, unless its on standby */
+static void qmcTask(void * data) {
+    if(!onPad)
+        iqSubmit(&qmcTxn);
+}
+
+/* Sets up all the I2C transactions the tasks use */
+static void setupTransactions(void) {
+    hpStartCmd = HP203MeasureCmd(HP_CHANNEL, hpOsr);
+    iqSetup(&hpStartTxn, HP203_ADDR, &hpStartCmd, 1, NULL, 0, hpStartDone);
+    iqSetup(&hpEndTxn, HP203_ADDR, &hpEndCmd, 1, hpBuf, 6, hpEndDone);
+    iqSetup(&qmcTxn, QMC_ADDR, &qmcReg, 1, qmcBuf, 6, qmcDone);
+
+    qmiDoneCmd[1] = QMIFifoDone(&qmi);
+    iqSetup(&qmiReqTxn, qmi.addr, qmiReqCmd, 2, NULL, 0, NULL);
+    iqSetup(&qmiPollTxn, qmi.addr, &qmiStatusReg, 1, &qmiStatus, 1, qmiPolled);
+    iqSetup(&qmiAckTxn, qmi.addr, qmiAckCmd, 2, NULL, 0, NULL);
+    iqSetup(&qmiCountTxn, qmi.addr, &qmiCountReg, 1, qmiCount, 2, NULL);
+    iqSetup(&qmiTsTxn, qmi.addr, &qmiTsReg, 1, qmiTs, 3, qmiCounted);
+    iqSetup(&qmiDataTxn, qmi.addr, &qmiDataReg, 1, qmiFifo, 0, NULL);
+    iqSetup(&qmiDoneTxn, qmi.addr, qmiDoneCmd, 2, NULL, 0, qmiDone);
+
+    iqSetup(&qmiWakeTxn, qmi.addr, qmiWakeCmd, 2, NULL, 0, NULL);
+    iqSetup(&qmcWakeTxn, QMC_ADDR, qmcWakeCmd, 2, NULL, 0, NULL);
 }
 
 /* ------------------------ CONFIG ------------------------ */
 
-/* Initialises the sensors and the associated i2c bus,
- * Kicks off the timers used to.. time things */
-void configureSensors(void)
+/* Copies the sensor settings from a built in profile into cfg.
+ * Returns 0 on success, 1 if theres no such profile. */
+uint8_t sensorProfile(uint8_t id, conf_t * cfg) {
+    if(id >= N_PROFILES)
+        return 1;
+
+    cfg->profile = profiles[id].profile;
+    cfg->i2cKhz  = profiles[id].i2cKhz;
+    cfg->imuOdr  = profiles[id].imuOdr;
+    cfg->compOdr = profiles[id].compOdr;
+    cfg->compOsr = profiles[id].compOsr;
+    cfg->baroOsr = profiles[id].baroOsr;
+    return 0;
+}
+
+/* Initialises the sensors and the associated i2c bus using the settings in
+ * cfg, then kicks off the timers used to.. time things.
+ * The timers and the I2C IRQ belong to the calling core, and sensor tasks
+ * are added to tl, which must only be run by that core. */
+void configureSensors(const conf_t * cfg, taskList_t * tl)
 {
 
     struct qmc_cfg qmcCfg;
+    int16_t ctrl7;
+
+    // Alarm pools fire on the core that made them. Core 0 already has one.
+    list = tl;
+    pool = get_core_num() ? alarm_pool_create(SAMPLER_ALARM, SAMPLER_TIMERS)
+                          : alarm_pool_get_default();
+
+    // Settings the tasks need
+    imuOdrUs = 125 << cfg->imuOdr;   // 8 kHz at 0, halving each step
+    flightOsr = cfg->baroOsr;
+    hpOsr = PAD_BARO_OSR;
+    onPad = true;
+
+    biquadReset(&baroVel);
+    maInit(&acclAvg, acclBuf, ACCL_AVG);
+
+    calBuild(&acclCal, &cfg->acclCal, ACCL_UNITS);
+    calBuild(&gyroCal, &cfg->gyroCal, GYRO_UNITS);
+    calBuild(&compCal, &cfg->compCal, COMP_UNITS);
+    estInit(imuOdrUs);
 
     // Configure the i2c bus.
-    i2c_init(i2c_default, 100 * 1000);
+    i2c_init(i2c_default, cfg->i2cKhz * 1000);
     gpio_set_function(16, GPIO_FUNC_I2C);
     gpio_set_function(17, GPIO_FUNC_I2C);
     gpio_pull_up(16);
@@ -170,27 +535,56 @@ void configureSensors(void)
     qmc = QMCInit(i2c_default);
     qmi = QMIInit(i2c_default, true);
 
+    // Read the QMI in single transfers if it'll let us.
+    QMIEnableBurst(&qmi);
+
     // Configure the QMI's gyro
-    QMIGyroConfig(&qmi, QMI_GYRO_125HZ, GYRO_RANGE);
+    QMIGyroConfig(&qmi, cfg->imuOdr, GYRO_RANGE);
     QMISetOption(&qmi, QMI_GYRO_ENABLE, true);
-    QMISetOption(&qmi, QMI_GYRO_SNOOZE, false);
 
     // Configure the QMI's accelerometer
-    QMIAccConfig(&qmi, QMI_ACC_125HZ, ACCL_RANGE);
+    QMIAccConfig(&qmi, cfg->imuOdr, ACCL_RANGE);
     QMISetOption(&qmi, QMI_ACC_ENABLE, true);
 
+    // The gyro starts off snoozing, see padWake. If CTRL7 cant be read the
+    // IMU isnt going to work anyway, so just wake it with both enabled.
+    ctrl7 = QMISetOption(&qmi, QMI_GYRO_SNOOZE, true);
+    qmiWakeCmd[1] = ctrl7 < 0 ? QMI_ACC_ENABLE | QMI_GYRO_ENABLE
+                              : ctrl7 & ~QMI_GYRO_SNOOZE;
+
+    // Let the QMI buffer samples between reads
+    QMIFifoConfig(&qmi, QMI_FIFO_STREAM, QMI_FIFO_64, IMU_BATCH);
+
     // Configure the QMC
-    qmcCfg.mode = QMC_CONTINUOUS;
-    qmcCfg.ODR = QMC_ODR_100HZ;
-    qmcCfg.OSR = QMC_OSR_256;
-    qmcCfg.scale = QMC_SCALE_2G;
+    qmcCfg.mode = QMC_STANDBY;
+    qmcCfg.ODR = cfg->compOdr;
+    qmcCfg.OSR = cfg->compOsr;
+    qmcCfg.scale = COMP_RANGE;
     qmcCfg.pointerRoll = true;
     qmcCfg.enableInterrupt = false;
 
     QMCSetCfg(&qmc, qmcCfg);
+    qmcCfg.mode = QMC_CONTINUOUS;
+    qmcWakeCmd[1] = qmcCfg.mode << QMC_MODE_SHIFT | qmcCfg.ODR << QMC_ODR_SHIFT
+                  | qmcCfg.OSR << QMC_OSR_SHIFT | qmcCfg.scale << QMC_SCALE_SHIFT;
+
+    // From here on the bus belongs to the I2C queue
+    setupTransactions();
+    iqInit(i2c_default, tl);
 
-    add_repeating_timer_ms(10, addRepeat, qmcTask, &qmcTimer);
-    add_repeating_timer_ms(10, addRepeat, qmiTask, &qmiTimer);
-    add_repeating_timer_ms(50, addRepeat, hpStartTask, &hpStartTimer);
+    alarm_pool_add_repeating_timer_ms(pool, qmcPeriods[cfg->compOdr & 3],
+                                      addRepeat, qmcTask, &qmcTimer);
+    qmiPeriodUs = MAX(1, IMU_BATCH / 2 * imuOdrUs / 1000) * 1000;
+    alarm_pool_add_repeating_timer_ms(pool, qmiPeriodUs / 1000,
+                                      qmiIRQ, qmiTask, &qmiTimer);
+    alarm_pool_add_repeating_timer_ms(pool, HP_PERIOD_MS,
+                                      addRepeat, hpStartTask, &hpStartTimer);
+
+}
 
+/* Gets how many ticks the IMU timer has missed since boot, because
+ * something kept its IRQ off for longer than a period, and the period. */
+uint32_t sensorMissed(uint32_t * periodUs) {
+    *periodUs = qmiPeriodUs;
+    return qmiMissed;
 }
@@ -6,18 +6,27 @@
 
 #include "pico/stdlib.h"
 #include "pico/bootrom.h"
+#include "pico/stdio_usb.h"
 #include "stdio.h"
 #include <hardware/sync.h>
 #include <hardware/timer.h>
 
 #include "ansi.h"
+#include "bench.h"
+#include "crc.h"
 #include "taskList.h"
 #include "types.h"
 #include "flash.h"
+#include "sampler.h"
+#include "detect.h"
+#include "estimator.h"
 #include "shell.h"
+#include "telemetry.h"
+#include "trace.h"
 
-// Task list
+// Task lists. sensorTl is the same as tl unless the sampler has its own core.
 extern taskList_t tl;
+extern taskList_t * sensorTl;
 
 // Latest data points
 extern baro_t baroData;
@@ -25,86 +34,502 @@ extern imu_t  imuData;
 extern comp_t compData;
 extern gps_t  gpsData;
 
+// Settings loaded at boot
+extern conf_t config;
+
+extern enum states state;
+
 // Big strings!
 static const char helpText[] =
     "Bob Rev 3 running build: %s %s\n"
     "Press:\n"
+    "a to show or set the sensor calibration\n"
     "b to enter bootsel mode\n"
     "c to clear the contents of the flash\n"
     "d to show the debug prompt\n"
+    "e to set the main's deploy altitude\n"
+    "f to read a single flight\n"
     "h to display this help text\n"
-    "r to read files\n";
+    "k to benchmark the flash\n"
+    "l to list flights\n"
+    "p to pick a flight profile\n"
+    "w to switch between linear and ring logging\n"
+    "r to read files\n"
+    "t to show task timings\n"
+    "x to read files in binary (use tools/bobdump.py)\n"
+    "z to zero the task timings\n";
 
 static const char outHeader[] =
     "BARO, time, pres, temp, delta\n"
     "IMU, time, acc x, acc y, acc z, acc filt, gyro x, gyro y, gyro z\n"
     "COMP, time, x, y, z\n"
-    "GPS, time, hrs, mins, sec, lat, lng, sats\n";
+    "GPS, time, hrs, mins, sec, lat, lng, sats\n"
+    "EVENT, time, state, latency us\n"
+    "EST, time, q w, q x, q y, q z, alt cm, vel dm/s\n";
+
+// Records printed per dumpTask. Tasks arent preempted, so keep this small
+// enough that higher priority tasks get a look in between batches.
+#define DUMP_BATCH 64
+
+/* Binary dumps are sent as frames of:
+ * "BOBD", offset into the log (u32), length (u16), data, CRC-32 (u32)
+ * All little endian, with the CRC covering everything after "BOBD". The last
+ * frame is empty. tools/bobdump.py turns them back into the CSV. */
+#define BIN_MAGIC "BOBD"
+#define BIN_CHUNK 1024
+
+typedef struct __attribute__((packed)) {
+    char     magic[4];
+    uint32_t offset;
+    uint16_t len;
+} binFrame_t;
+
+static uint32_t binOffset = 0;
 
 // Timer
 static repeating_timer_t shellTimer;
 
+/* Prompts get the keys typed one at a time, from a task that polls stdin
+ * the same way shellTask does, so the rest of the task list keeps running
+ * while the user thinks. Each key is handed to the prompt's function. */
+#define PROMPT_TIMEOUT_US 30000000
+
+typedef enum {
+    PROMPT_MORE,    // Wants another key
+    PROMPT_DONE,    // Finished, start the shell again
+    PROMPT_HANDED,  // Finished, and started a task that starts the shell
+} promptRes_t;
+
+typedef promptRes_t (*promptFn_t)(int in);
+
+static promptFn_t promptFn;
+static uint32_t promptUs;   // When the last key came in
+
 /* --------------------- PROTOTYPES -------------------- */
 
 static inline void shellStop(void);
-inline void shellStart(void);
 static bool shellIRQ(repeating_timer_t * rt);
+static void dumpTask(void * ptr);
+
+/* ---------------------- PROMPTS ---------------------- */
+
+/* Polls for the next key of a prompt, giving up if nothing is typed for
+ * PROMPT_TIMEOUT_US. */
+static void promptTask(void * ptr) {
+    int in = getchar_timeout_us(0);
+
+    if(in == PICO_ERROR_TIMEOUT) {
+        if(time_us_32() - promptUs < PROMPT_TIMEOUT_US) {
+            tlAddPrio(&tl, TL_LOW, promptTask, NULL);
+            return;
+        }
+        printf("Timed out due to lack of response, please try again\n");
+        shellInit();
+        return;
+    }
+
+    promptUs = time_us_32();
+    switch(promptFn(in)) {
+    case PROMPT_MORE:
+        tlAddPrio(&tl, TL_LOW, promptTask, NULL);
+        break;
+    case PROMPT_DONE:
+        shellInit();
+        break;
+    case PROMPT_HANDED:
+        break;
+    }
+}
+
+/* Stops the shell and hands the keys typed from now on to fn */
+static void promptStart(promptFn_t fn) {
+    promptFn = fn;
+    promptUs = time_us_32();
+    shellStop();
+    tlAddPrio(&tl, TL_LOW, promptTask, NULL);
+}
 
 /* ----------------------- TASKS ----------------------- */
 
+/* Starts the wipe if the answer was yes */
+static promptRes_t wipeKey(int in) {
+    if(in == 'y') {
+        fErase();
+        printf("Clearing flash in the background, "
+               "see the debug prompt for progress.\n"
+               "Dont power off until its done!\n");
+    }
+    return PROMPT_DONE;
+}
+
 static void flashWipe(void) {
     printf(NORM
            "Are you sure you wish to clear the flash? "
            "["GREEN "Y" WHITE "/" RED "N" WHITE "]\n"
            NORM);
-    switch(getchar_timeout_us(30000000)){
-    case PICO_ERROR_TIMEOUT:
-        printf("Timed out due to lack of response, please try again\n");
-        break;
-    case 'y':
-        printf("Clearing flash. (This may take a while) \n");
-        fErase();
-        printf("Done!\n");
-        break;
+    promptStart(wipeKey);
+}
+
+/* Takes the profile number typed and saves it to flash */
+static promptRes_t profileKey(int in) {
+    if(in < '0' || sensorProfile(in - '0', &config)) {
+        printf("No such profile\n");
+        return PROMPT_DONE;
     }
+
+    fSaveConfig(&config);
+    printf("Saved profile %u, takes effect after a reboot\n", config.profile);
+    return PROMPT_DONE;
+}
+
+/* Lets the user pick one of the built in profiles and saves it to flash.
+ * The sensors are only configured at boot, so it needs a reboot. */
+static void profilePick(void) {
+    printf(NORM "Current profile: %u\n"
+           "0: Default (100 kHz I2C, 250 Hz IMU)\n"
+           "1: Fast    (400 kHz I2C, 500 Hz IMU)\n"
+           "2: Max     (1 MHz I2C,   1 kHz IMU)\n"
+           "Enter a profile number: \n", config.profile);
+    promptStart(profileKey);
+}
+
+// Line typed so far, for prompts that take one
+static char lineBuf[128];
+static uint32_t lineLen;
+static void (*lineFn)(const char * line);
+
+/* Echoes each key back into lineBuf, then hands it to lineFn on enter */
+static promptRes_t lineKey(int in) {
+    if(in == '\r' || in == '\n') {
+        lineBuf[lineLen] = '\0';
+        printf("\n");
+        lineFn(lineBuf);
+        return PROMPT_DONE;
+    }
+
+    if(lineLen < sizeof(lineBuf) - 1) {
+        lineBuf[lineLen++] = in;
+        putchar(in);
+    }
+    return PROMPT_MORE;
+}
+
+/* Reads a line from the console, then hands it to fn */
+static void lineStart(void (*fn)(const char * line)) {
+    lineLen = 0;
+    lineFn = fn;
+    promptStart(lineKey);
+}
+
+static const char calNames[3] = {'a', 'g', 'c'};
+
+/* Takes a sensor and its 12 values and saves them to flash */
+static void calLine(const char * line) {
+    cal_t * cals[3] = {&config.acclCal, &config.gyroCal, &config.compCal};
+    char which;
+    int v[12];
+    int i, j;
+
+    if(line[0] == '\0')
+        return;
+
+    if(sscanf(line, " %c %d %d %d %d %d %d %d %d %d %d %d %d", &which,
+              &v[0], &v[1], &v[2], &v[3], &v[4], &v[5],
+              &v[6], &v[7], &v[8], &v[9], &v[10], &v[11]) != 13) {
+        printf("Need a sensor and 12 values\n");
+        return;
+    }
+
+    for(i = 0; i < 3 && calNames[i] != which; i++);
+    if(i == 3) {
+        printf("No such sensor\n");
+        return;
+    }
+
+    for(j = 0; j < 3; j++)
+        cals[i]->offset[j] = MIN(MAX(v[j], INT16_MIN), INT16_MAX);
+    for(j = 0; j < 9; j++)
+        cals[i]->scale[j / 3][j % 3] = MIN(MAX(v[j + 3], INT16_MIN), INT16_MAX);
+
+    fSaveConfig(&config);
+    printf("Saved, takes effect after a reboot\n");
+}
+
+/* Shows the calibration for each sensor, then lets the user type in a new
+ * one for one of them and saves it to flash. The sampler builds its tables
+ * at boot, so it needs a reboot. */
+static void calEdit(void) {
+    const cal_t * cals[3] = {&config.acclCal, &config.gyroCal, &config.compCal};
+    int i, j;
+
+    printf(NORM "Sensor, offset x, y, z, then the scale matrix row by row\n");
+    for(i = 0; i < 3; i++) {
+        printf("%c", calNames[i]);
+        for(j = 0; j < 3; j++)
+            printf(", %d", cals[i]->offset[j]);
+        for(j = 0; j < 9; j++)
+            printf(", %d", cals[i]->scale[j / 3][j % 3]);
+        printf("\n");
+    }
+
+    printf("Offsets are in the logged units, and the scale is Q14 on top of "
+           "identity. Enter a sensor (a, g or c) and its 12 values, space "
+           "separated, or nothing to leave it alone:\n");
+    lineStart(calLine);
+}
+
+/* Takes the deploy altitude in m and saves it as a pressure off the pad's */
+static void mainLine(const char * line) {
+    int m;
+
+    if(line[0] == '\0')
+        return;
+
+    if(sscanf(line, "%d", &m) != 1 || m < 0) {
+        printf("Need an altitude in m\n");
+        return;
+    }
+
+    config.mainPres = m ? estPresAbove(baroData.pres, m * 100) : 0;
+    fSaveConfig(&config);
+    printf("Saved main at %u Pa, takes effect after a reboot\n",
+           config.mainPres);
+}
+
+/* Asks for the altitude over the pad to deploy the main at, and saves the
+ * pressure there to flash. That has to come off the pad's pressure, so its
+ * only done sat on the pad with the baro running. Detection loads it at
+ * boot, so it needs a reboot. */
+static void mainEdit(void) {
+    if(state != GROUNDED || !baroData.pres) {
+        printf(NORM "Only on the pad, with the baro running\n");
+        return;
+    }
+
+    if(config.mainPres) {
+        printf(NORM "Main at %u Pa, pad at %u Pa\n", config.mainPres,
+               baroData.pres);
+    } else {
+        printf(NORM "No main, pad at %u Pa\n", baroData.pres);
+    }
+    printf("Enter the altitude over the pad to deploy the main at in m, 0 "
+           "for no main, or nothing to leave it alone:\n");
+    lineStart(mainLine);
+}
+
+/* Switches between a linear and a ring log and saves it to flash. The log
+ * is picked at boot, and the old one wont make sense in the other mode, so
+ * it needs a wipe and a reboot. */
+static void logModeToggle(void) {
+    config.ringLog = !config.ringLog;
+    fSaveConfig(&config);
+    printf(NORM "Switched to %s logging. Clear the flash, then reboot.\n",
+           config.ringLog ? "ring" : "linear");
+}
+
+/* Lists the sessions in the flash directory */
+static void sessionList(void) {
+    session_t sess;
+    int i;
+
+    printf(NORM "Flight, start, kiB, time, records\n");
+    for(i = 0; !fGetSession(i, &sess); i++) {
+        if(sess.records == 0xFFFFFFFF) {
+            printf("%d, 0x%08x, %u, %u, ?\n", i, sess.start,
+                   (sess.end - sess.start) >> 10, sess.time);
+        } else {
+            printf("%d, 0x%08x, %u, %u, %u\n", i, sess.start,
+                   (sess.end - sess.start) >> 10, sess.time, sess.records);
+        }
+    }
+    printf("%d flights\n", i);
+}
+
+// Flight number typed so far
+static int pickN, pickDigits;
+
+/* Takes the digits of a flight number up to anything else, then points the
+ * read pointer at it and dumps it */
+static promptRes_t sessionKey(int in) {
+    if(in >= '0' && in <= '9' && pickDigits < 3) {
+        pickN = pickN * 10 + in - '0';
+        pickDigits++;
+        return PROMPT_MORE;
+    }
+
+    if(!pickDigits || fSeekSession(pickN)) {
+        printf("No such flight\n");
+        return PROMPT_DONE;
+    }
+
+    printf(outHeader);
+    tlAddPrio(&tl, TL_LOW, dumpTask, NULL);
+    return PROMPT_HANDED;
+}
+
+/* Asks for a flight number, then dumps that flight */
+static void sessionPick(void) {
+    pickN = 0;
+    pickDigits = 0;
+    printf(NORM "Enter a flight number, then press enter: \n");
+    promptStart(sessionKey);
+}
+
+/* Prints the timings of each traced section, with its histogram */
+static void traceShow(void) {
+    traceStat_t s;
+    int i, b;
+
+    printf(NORM "Section, count, min us, mean us, max us");
+    for(b = 0; b < TRACE_BUCKETS - 1; b++)
+        printf(", <%u", TRACE_MIN_US << b);
+    printf(", more\n");
+
+    for(i = 0; i < TR_IDS; i++) {
+        traceGet(i, &s);
+        printf("%s, %u, %u, %u, %u", traceName(i), s.count, s.min,
+               s.count ? s.total / s.count : 0, s.max);
+        for(b = 0; b < TRACE_BUCKETS; b++)
+            printf(", %u", s.hist[b]);
+        printf("\n");
+    }
+
+    printf("Deepest task list: Main: %u  Sensor: %u  of %d\n",
+           traceDepthMax(TQ_MAIN), traceDepthMax(TQ_SENSOR),
+           TL_SIZE * TL_PRIOS);
+}
+
+/* Starts the flash benchmark, if were not flying */
+static bool benchBegin(void) {
+    if(state != BOOT && state != GROUNDED && state != LANDED) {
+        printf(NORM "Not while flying!\n");
+        return false;
+    }
+
+    switch(benchStart()) {
+    case 1:
+        printf(NORM "The program runs into the scratch block, "
+               "cant benchmark\n");
+        return false;
+    case 2:
+        printf(NORM "Already benchmarking\n");
+        return false;
+    }
+
+    printf(NORM "Benchmarking the flash, this takes a few seconds...\n");
+    return true;
+}
+
+/* Waits for the flash benchmark, then prints how each case went */
+static void benchTask(void * ptr) {
+    bench_t b;
+    uint32_t periodUs, missed, biquadCyc, maCyc;
+    int i;
+
+    if(benchProgress() < 100) {
+        tlAddPrio(&tl, TL_LOW, benchTask, NULL);
+        return;
+    }
+
+    missed = sensorMissed(&periodUs);
+    printf(NORM "Op, bytes, offset, calls, min us, mean us, max us, MB/s, "
+           "missed ticks\n");
+    for(i = 0; !benchGet(i, &b); i++) {
+        uint32_t rate = b.totalUs ? (uint64_t) b.len * b.calls * 100 / b.totalUs : 0;
+
+        printf("%c, %u, %u, %u, %u, %u, %u, %u.%02u, %u\n", b.op, b.len,
+               b.offs, b.calls, b.minUs, b.calls ? b.totalUs / b.calls : 0,
+               b.maxUs, rate / 100, rate % 100, b.missed);
+    }
+    printf("IMU timer every %u us, %u ticks missed since boot\n",
+           periodUs, missed);
+
+    benchFilters(&biquadCyc, &maCyc);
+    printf("Filters: biquadStep %u cycles, maStep %u cycles\n",
+           biquadCyc, maCyc);
+    shellInit();
 }
 
 /* Dumps a bunch of records from flash, then yeilds the CPU to allow other
- * stuff to happen */
+ * stuff to happen. Records are printed straight out of flash. */
 static void dumpTask(void * ptr) {
-    int i, j;
-    log_t l;
-    for(i = 0; i < 400000; i++) {
+    const log_t * l;
+    int i;
+    uint32_t start = traceStart();
+
+    for(i = 0; i < DUMP_BATCH; i++) {
         // Attempt to read from flash.
-        if(fRead(&l)) {
+        if((l = fNext()) == NULL) {
+            traceEnd(TR_DUMP, start);
             shellInit();
-            break;
+            return;
         }
-        switch (l.type) {
+        switch (l->type) {
         case BARO:;
-            baro_t b = l.data.baro;
-            printf("BARO, %u, %u, %d, %d\n", b.time,
-                   b.pres, b.temp, b.vVel);
+            const baro_t * b = &l->data.baro;
+            printf("BARO, %u, %u, %d, %d\n", b->time,
+                   b->pres, b->temp, b->vVel);
             break;
         case IMU:;
-            imu_t i = l.data.imu;
-            printf("IMU, %u, %d, %d, %d, %d, %d, %d\n", i.time,
-                   i.accl[0], i.accl[1], i.accl[2], i.acclFilt,
-                   i.gyro[0], i.gyro[1], i.gyro[2]);
+            const imu_t * m = &l->data.imu;
+            printf("IMU, %u, %d, %d, %d, %d, %d, %d, %d\n", m->time,
+                   m->accl[0], m->accl[1], m->accl[2], m->acclFilt,
+                   m->gyro[0], m->gyro[1], m->gyro[2]);
             break;
         case COMP:;
-            comp_t c = l.data.comp;
-            printf("COMP, %u, %d, %d, %d\n", c.time,
-                   c.compass[0], c.compass[1], c.compass[2]);
+            const comp_t * c = &l->data.comp;
+            printf("COMP, %u, %d, %d, %d\n", c->time,
+                   c->compass[0], c->compass[1], c->compass[2]);
             break;
         case GPS:;
-            gps_t g = l.data.gps;
-            printf("GPS, %u, %u, %u, %u, %d, %d, %u\n", g.time,
-                   g.utc[0], g.utc[1], g.utc[2], g.lat, g.lon, g.sats);
+            const gps_t * g = &l->data.gps;
+            printf("GPS, %u, %u, %u, %u, %d, %d, %u\n", g->time,
+                   g->utc[0], g->utc[1], g->utc[2], g->lat, g->lon, g->sats);
+            break;
+        case EVENT:;
+            const event_t * e = &l->data.event;
+            printf("EVENT, %u, %c, %u\n", e->time, e->state, e->latency);
+            break;
+        case EST:;
+            const est_t * s = &l->data.est;
+            printf("EST, %u, %d, %d, %d, %d, %d, %d\n", s->time, s->quat[0],
+                   s->quat[1], s->quat[2], s->quat[3], s->alt, s->vVel);
             break;
         }
     }
-    tlAdd(&tl, dumpTask, NULL);
+    traceEnd(TR_DUMP, start);
+    tlAddPrio(&tl, TL_LOW, dumpTask, NULL);
+}
+
+/* Sends the next frame of a binary dump straight out of flash, then yields
+ * the CPU. CR/LF translation is off for the duration of the dump. */
+static void binDumpTask(void * ptr) {
+    binFrame_t frame = {.magic = BIN_MAGIC};
+    const uint8_t * log;
+    uint32_t len, crc;
+
+    // The log can shrink under a dump if its wiped, or reclaimed in ring
+    // mode. Then end it, rather than sending whats past the new end.
+    log = fRawLog(&len);
+    frame.offset = binOffset;
+    frame.len = binOffset < len ? MIN(len - binOffset, BIN_CHUNK) : 0;
+
+    crc = crc32(0, &frame.offset, sizeof(frame) - sizeof(frame.magic));
+    crc = crc32(crc, log + binOffset, frame.len);
+
+    fwrite(&frame, sizeof(frame), 1, stdout);
+    fwrite(log + binOffset, 1, frame.len, stdout);
+    fwrite(&crc, sizeof(crc), 1, stdout);
+    fflush(stdout);
+
+    if(frame.len == 0) {
+        stdio_set_translate_crlf(&stdio_usb, true);
+        shellInit();
+        return;
+    }
+
+    binOffset += frame.len;
+    tlAddPrio(&tl, TL_LOW, binDumpTask, NULL);
 }
 
 static void ignore(void) {
@@ -127,28 +552,54 @@ static void debugTask(void * ptr) {
         NORM
         "Barometer:     Pressure:     %7u Pa      Temp: %7d" "\n"
         NORM
-        "Task List:     %d / %d\n"
+        "State:         %c  Worst latency: IMU: %u us  Baro: %u us\n"
+        NORM
+        "Task List:     %d / %d  Deepest: Main: %u  Sensor: %u\n"
         NORM
-        "Flash:         %d kiB \n"
+        "Worst:         fTask: %u us  IRQs off: %u us  qmiDone: %u us  hpEndDone: %u us\n"
+        NORM
+        "Tasks Dropped: High: %u  Norm: %u  Low: %u\n"
+        NORM
+        "Flash:         %d kiB  Erased: %3d%%\n"
+        NORM
+        "Dropped:       %u records\n"
+        NORM
+        "Telemetry:     %u sent  %u skipped  %u acks\n"
+        NORM
+        "Link:          Profile: %u  Every %u ms  RSSI: %d dBm  SNR: %d dB\n"
         NORM
         "\n"
         "Press any key to exit. \n"
         CLRLN NORM
         "\x1b[0J\n";
+    uint32_t imuLat, baroLat;
+    telemStats_t telem;
+    traceStat_t fTr, irqTr, qmiTr, hpTr;
 
+    detectLatency(&imuLat, &baroLat);
+    telemStats(&telem);
+    traceGet(TR_FTASK, &fTr);
+    traceGet(TR_IRQS_OFF, &irqTr);
+    traceGet(TR_QMI_DONE, &qmiTr);
+    traceGet(TR_HP_DONE, &hpTr);
     printf(prompt, __TIME__, __DATE__, to_ms_since_boot(get_absolute_time()),
            imuData.accl[0], imuData.accl[1], imuData.accl[2],
            imuData.gyro[0], imuData.gyro[1], imuData.gyro[2],
            compData.compass[0], compData.compass[1], compData.compass[2],
            gpsData.lat, gpsData.lon, gpsData.sats,
            baroData.pres, baroData.temp,
-           tlSize(&tl), TL_SIZE,
-           fUsed());
+           state, imuLat, baroLat, tlSize(&tl), TL_SIZE * TL_PRIOS,
+           traceDepthMax(TQ_MAIN), traceDepthMax(TQ_SENSOR),
+           fTr.max, irqTr.max, qmiTr.max, hpTr.max,
+           tlDropped(sensorTl, TL_HIGH), tlDropped(&tl, TL_NORM), tlDropped(&tl, TL_LOW),
+           fUsed(), fEraseProgress(), fDropped(),
+           telem.sent, telem.skipped, telem.acks,
+           telem.link, telem.periodMs, telem.rssi, telem.snr / 4);
 
     if(getchar_timeout_us(0) != PICO_ERROR_TIMEOUT) {
         shellInit();
     } else {
-        tlAdd(&tl, debugTask, NULL);
+        tlAddPrio(&tl, TL_LOW, debugTask, NULL);
     }
 }
 
@@ -165,6 +616,9 @@ static void shellTask(void * ptr) {
     int in = getchar_timeout_us(0);
 
     switch(in) {
+    case 'a':
+        calEdit();
+        break;
     case 'b':
         printf("Entering bootsel mode...\n");
         reset_usb_boot(0,0);
@@ -174,18 +628,53 @@ static void shellTask(void * ptr) {
         break;
     case 'd':
         shellStop();
-        tlAdd(&tl, debugTask, NULL);
+        tlAddPrio(&tl, TL_LOW, debugTask, NULL);
+        break;
+    case 'e':
+        mainEdit();
+        break;
+    case 'f':
+        sessionPick();
         break;
     case 'h':
         printf(helpText, __TIME__, __DATE__);
         break;
+    case 'k':
+        if(!benchBegin())
+            break;
+        shellStop();
+        tlAddPrio(&tl, TL_LOW, benchTask, NULL);
+        break;
+    case 'l':
+        sessionList();
+        break;
     case 'm':
         ignore();
         break;
+    case 'p':
+        profilePick();
+        break;
     case 'r':
+        fRewind();
         printf(outHeader);
         shellStop();
-        tlAdd(&tl, dumpTask, NULL);
+        tlAddPrio(&tl, TL_LOW, dumpTask, NULL);
+        break;
+    case 't':
+        traceShow();
+        break;
+    case 'w':
+        logModeToggle();
+        break;
+    case 'x':
+        binOffset = 0;
+        stdio_set_translate_crlf(&stdio_usb, false);
+        shellStop();
+        tlAddPrio(&tl, TL_LOW, binDumpTask, NULL);
+        break;
+    case 'z':
+        traceReset();
+        printf(NORM "Task timings cleared\n");
         break;
     }
 }
@@ -194,7 +683,7 @@ static void shellTask(void * ptr) {
 
 
 static bool shellIRQ(repeating_timer_t * rt) {
-    tlAdd(&tl, shellTask, NULL);
+    tlAddPrio(&tl, TL_LOW, shellTask, NULL);
     return true;
 }
 
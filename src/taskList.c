@@ -15,26 +15,47 @@ taskList_t tlInit(void) {
  * 1 if no items remain in the task list.
  */
 uint8_t tlRun(taskList_t * tl) {
-    uint8_t nextTail = (tl->tail + 1) % TL_SIZE;
+    tlQueue_t * q;
     task_t toRun;
+    int p;
 
     int ints = save_and_disable_interrupts();
 
-    if (tl->tail == tl->head) {
+    // Find the highest priority queue with something in it
+    for(p = 0; p < TL_PRIOS; p++) {
+        q = &tl->queues[p];
+        if(q->tail != q->head)
+            break;
+    }
+
+    if (p == TL_PRIOS) {
         // List is empty
         restore_interrupts(ints);
         return 1;
     } else {
         // Run next task
-        tl->tail = nextTail;
-        toRun = tl->tasks[tl->tail];
+        q->tail = (q->tail + 1) % TL_SIZE;
+        toRun = q->tasks[q->tail];
         restore_interrupts(ints);
         (toRun.taskPtr) (toRun.dataPtr);
         return 0;
     }
 };
 
-/* Adds an item to the task list
+/* Sleeps until the next interrupt, unless something is already waiting to
+ * run. Interrupts are off from the check to the WFI, so a task added in
+ * between cant be slept through: a pending interrupt still wakes the WFI,
+ * then runs as soon as they are back on. */
+void tlIdle(taskList_t * tl) {
+    int ints = save_and_disable_interrupts();
+
+    if(!tlSize(tl))
+        __wfi();
+
+    restore_interrupts(ints);
+}
+
+/* Adds an item to the task list at TL_NORM priority
  * Parameters:
  * tl - The task list
  * taskPtr - A function pointer
@@ -44,27 +65,58 @@ uint8_t tlRun(taskList_t * tl) {
  * 1 if no room remains in the task list
  */
 uint8_t tlAdd(taskList_t * tl, void (*taskPtr) (void * ), void * dataPtr) {
-    uint8_t nextHead = (tl->head + 1) % TL_SIZE;
+    return tlAddPrio(tl, TL_NORM, taskPtr, dataPtr);
+}
+
+/* Adds an item to the task list at the given priority
+ * Parameters:
+ * tl - The task list
+ * prio - Which queue to add it to
+ * taskPtr - A function pointer
+ * dataPtr - a pointer that will be passed to taskPtr when run
+ * Returns:
+ * 0 on success
+ * 1 if no room remains in that priority's queue
+ */
+uint8_t tlAddPrio(taskList_t * tl, enum tlPrio prio,
+                  void (*taskPtr) (void * ), void * dataPtr) {
+    tlQueue_t * q = &tl->queues[prio];
     task_t toAdd;
 
     toAdd.taskPtr = taskPtr;
     toAdd.dataPtr = dataPtr;
 
     int ints = save_and_disable_interrupts();
-    if(nextHead == tl->tail) {
+    uint8_t nextHead = (q->head + 1) % TL_SIZE;
+    if(nextHead == q->tail) {
         // List is full
+        q->dropped++;
         restore_interrupts(ints);
         return 1;
     } else {
         // Add to list
-        tl->head = nextHead;
-        tl->tasks[nextHead] = toAdd;
+        q->head = nextHead;
+        q->tasks[nextHead] = toAdd;
         restore_interrupts(ints);
         return 0;
     }
 }
 
-/* Returns the number of items in a task list */
+/* Returns the number of items in a task list, across all priorities */
 uint8_t tlSize(taskList_t * tl) {
-    return (TL_SIZE - tl->head + tl->tail) % TL_SIZE;
+    tlQueue_t * q;
+    uint8_t size = 0;
+    int p;
+
+    for(p = 0; p < TL_PRIOS; p++) {
+        q = &tl->queues[p];
+        size += (TL_SIZE + q->head - q->tail) % TL_SIZE;
+    }
+
+    return size;
+}
+
+/* Returns the number of tasks dropped at the given priority */
+uint32_t tlDropped(taskList_t * tl, enum tlPrio prio) {
+    return tl->queues[prio].dropped;
 }
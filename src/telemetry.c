@@ -0,0 +1,335 @@
+#include "telemetry.h"
+#include "bob.h"
+#include "sx127x.h"
+#include "taskList.h"
+#include "types.h"
+
+#include <pico/stdlib.h>
+#include <hardware/dma.h>
+#include <hardware/gpio.h>
+#include <hardware/irq.h>
+#include <hardware/spi.h>
+#include <hardware/timer.h>
+
+// Helper functions
+#define NOW_MS to_ms_since_boot(get_absolute_time())
+#define NOW_US time_us_32()
+
+// Radio settings
+#define TELEM_SPI    spi0
+#define TELEM_SPI_HZ (8 * 1000 * 1000)
+#define TELEM_FREQ   433000000
+
+// The task runs every TELEM_TICK_MS and sends whenever a frame is due
+#define TELEM_TICK_MS 50
+#define TELEM_MIN_MS  100
+
+// Frames and acks get this much of the airtime, with TELEM_TURNAROUND_MS
+// on top of each for the ground to get its ack out.
+#define TELEM_BUDGET_PCT    70
+#define TELEM_TURNAROUND_MS 20
+#define TELEM_ACK_LEN       2
+
+// Link quality, as SNR margin over the demodulation floor in quarter dB.
+// The floor is -2.5 dB per step of SF past 4.
+#define TELEM_MARGIN_LOW  (10 * 4)
+#define TELEM_MARGIN_HIGH (20 * 4)
+#define TELEM_GOOD        5     // Strong acks in a row before going faster
+#define TELEM_NOTICE      3     // Frames a change is announced for
+
+// If DIO0 hasnt gone off after this long, assume it was missed and start
+// again. Twice the longest frame LoRa can send: a full telem_t at SF12,
+// 125 kHz and 4/8 is 1.97 s by SXAirtimeUs.
+#define TELEM_TIMEOUT_US (4 * 1000 * 1000)
+
+// Externs
+extern enum states state;
+
+extern baro_t baroData;
+extern imu_t  imuData;
+extern gps_t  gpsData;
+
+/* Link profiles, fastest first. Only the slow one saves airtime by sending
+ * short frames; it is for getting a position back from far away. */
+typedef struct {
+    uint8_t sf;
+    enum SX_BW bw;
+    uint8_t cr;
+    bool full;            // Send telem_t rather than telemShort_t
+} link_t;
+
+static const link_t links[TELEM_LINKS] = {
+    {7,  SX_BW_250K, 5, true},     // About 10 Hz, for the pad and boost
+    {9,  SX_BW_125K, 5, true},     // About 2 Hz
+    {11, SX_BW_125K, 8, false}     // About every 2 s, well past apogee
+};
+
+static sx127x_t radio;
+static taskList_t * list = NULL;
+static int dmaChan;
+static repeating_timer_t telemTimer;
+
+// The frame being sent. Only written while the radio is idle, as the DMA
+// reads straight out of it.
+static union {
+    telem_t full;
+    telemShort_t brief;
+} frame;
+static uint8_t frameLen;
+static uint8_t seq = 0;
+static bool busy = false;
+static uint32_t txStartUs;
+static uint32_t lastTxMs;
+
+// Link state
+static uint8_t  link = 0;      // Profile in use
+static uint8_t  next = 0;      // Profile being changed to
+static uint8_t  left = 0;      // Frames until the change
+static uint8_t  want = 0;      // Profile the link would like to be on
+static uint16_t periodMs;
+static bool     descent = false;
+
+// Acks
+static bool    heard = false;  // Has the ground ever acked us?
+static bool    acked = true;   // Was the last frame acked?
+static uint8_t lastSeq;
+static uint8_t misses = 0;
+static uint8_t good = 0;
+
+static telemStats_t stats;
+
+/* ------------------------ LINK ------------------------  */
+
+/* Is the flight past apogee? */
+static bool telemDescending(void) {
+    switch(state) {
+    case DROGUE_FIRE:
+    case DROGUE_OUT:
+    case MAIN_FIRE:
+    case MAIN_OUT:
+    case LANDED:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Puts the radio on a profile and works out how often it can send.
+ * Must be in standby. */
+static void telemSetLink(uint8_t l) {
+    const link_t * p = &links[l];
+    uint32_t airUs;
+
+    airUs = SXAirtimeUs(p->sf, p->bw, p->cr,
+                        p->full ? sizeof(telem_t) : sizeof(telemShort_t))
+          + SXAirtimeUs(p->sf, p->bw, p->cr, TELEM_ACK_LEN);
+
+    SXSetModem(&radio, p->sf, p->bw, p->cr);
+    link = l;
+    next = l;
+    good = 0;
+    periodMs = MAX(TELEM_MIN_MS, airUs / (10 * TELEM_BUDGET_PCT)
+                                 + 2 * TELEM_TURNAROUND_MS);
+}
+
+/* Works out which profile the next frame goes out on */
+static void telemChooseLink(void) {
+    uint8_t fastest = 0;
+
+    if(telemDescending()) {
+        fastest = 1;
+        if(!descent) {
+            descent = true;
+            want = TELEM_LINKS - 1;
+        }
+    }
+
+    // Once we know the ground is listening, losing it means going long.
+    if(heard && !acked && ++misses >= TELEM_MISSES)
+        want = TELEM_LINKS - 1;
+
+    want = MAX(want, fastest);
+
+    // Finish a change thats been announced, or announce a new one
+    if(left && --left == 0) {
+        telemSetLink(next);
+    } else if(!left && want != link) {
+        next = want;
+        left = TELEM_NOTICE;
+    }
+}
+
+/* Moves the link on from an ack's SNR */
+static void telemAcked(int16_t rssi, int8_t snr) {
+    int16_t margin = snr + (links[link].sf - 4) * 10;
+
+    heard = true;
+    acked = true;
+    misses = 0;
+    stats.acks++;
+    stats.rssi = rssi;
+    stats.snr = snr;
+
+    if(margin < TELEM_MARGIN_LOW) {
+        want = MIN(link + 1, TELEM_LINKS - 1);
+        good = 0;
+    } else if(margin > TELEM_MARGIN_HIGH && ++good >= TELEM_GOOD) {
+        want = link ? link - 1 : 0;
+        good = 0;
+    }
+}
+
+/* Packs the latest data into the frame for the current profile */
+static void telemPack(void) {
+    uint8_t l = TELEM_LINK(link, next, left);
+    int16_t vVel = MIN(MAX(baroData.vVel, INT16_MIN), INT16_MAX);
+
+    if(links[link].full) {
+        frame.full.seq      = seq;
+        frame.full.link     = l;
+        frame.full.state    = state;
+        frame.full.time     = NOW_MS;
+        frame.full.pres     = baroData.pres;
+        frame.full.vVel     = vVel;
+        frame.full.acclFilt = MIN(MAX(imuData.acclFilt, 0), UINT16_MAX);
+        frame.full.lat      = gpsData.lat;
+        frame.full.lon      = gpsData.lon;
+        frame.full.sats     = gpsData.sats;
+        frameLen = sizeof(telem_t);
+    } else {
+        frame.brief.seq   = seq;
+        frame.brief.link  = l;
+        frame.brief.state = state;
+        frame.brief.pres  = baroData.pres;
+        frame.brief.vVel  = vVel;
+        frame.brief.lat   = gpsData.lat;
+        frame.brief.lon   = gpsData.lon;
+        frameLen = sizeof(telemShort_t);
+    }
+
+    lastSeq = seq++;
+}
+
+/* ----------------------- TASKS ------------------------  */
+
+/* DIO0 has gone off. Either the frame has gone, in which case listen for
+ * the ack, or the ack has come in. */
+static void telemDio0(void * data) {
+    uint8_t flags = SXIrqFlags(&radio);
+    uint8_t ack[TELEM_ACK_LEN];
+
+    SXClearIrq(&radio, flags);
+
+    if(flags & SX_IRQ_TX_DONE) {
+        stats.sent++;
+        busy = false;
+        SXReceive(&radio);
+    }
+
+    if((flags & SX_IRQ_RX_DONE) && !(flags & SX_IRQ_CRC_ERR)
+    && SXReadPacket(&radio, ack, TELEM_ACK_LEN) == TELEM_ACK_LEN
+    && ack[0] == TELEM_ACK && ack[1] == lastSeq) {
+        telemAcked(SXPacketRssi(&radio), SXPacketSnr(&radio));
+    }
+}
+
+/* Sends a frame if one is due. Packs the latest data and starts it going
+ * into the FIFO; the DMA IRQ takes it from there. */
+static void telemTask(void * data) {
+    uint32_t now = NOW_MS;
+
+    if(now - lastTxMs < periodMs)
+        return;
+    lastTxMs = now;
+
+    if(busy) {
+        if(NOW_US - txStartUs < TELEM_TIMEOUT_US) {
+            stats.skipped++;
+            return;
+        }
+        // DIO0 must have been missed. Put the radio back and carry on.
+        SXClearIrq(&radio, 0xFF);
+    }
+
+    // Stop listening for the last ack
+    SXSetMode(&radio, SX_MODE_STDBY);
+    SXWriteReg(&radio, SX_REG_DIO_MAPPING_1, SX_DIO0_TXDONE);
+
+    telemChooseLink();
+    telemPack();
+
+    acked = false;
+    busy = true;
+    txStartUs = NOW_US;
+    SXFifoBegin(&radio, frameLen);
+    dma_channel_transfer_from_buffer_now(dmaChan, &frame, frameLen);
+}
+
+/* ----------------------- IRQs ------------------------  */
+
+static bool telemIRQ(repeating_timer_t *rt) {
+    tlAdd(list, telemTask, NULL);
+    return true;
+}
+
+/* The frame is in the SPI FIFO, so finish the burst and send it */
+static void telemDmaIRQ(void) {
+    dma_hw->ints0 = 1u << dmaChan;
+    SXFifoEnd(&radio);
+    SXSetMode(&radio, SX_MODE_TX);
+}
+
+static void telemDio0IRQ(uint gpio, uint32_t events) {
+    if(gpio == BOB_LORA_DIO0)
+        tlAdd(list, telemDio0, NULL);
+}
+
+/* ------------------ PUBLIC FUNCTIONS ------------------ */
+
+/* Sets up the radio and starts sending, on the fastest profile.
+ * Returns 0 on success, 1 if theres no radio. */
+uint8_t telemInit(taskList_t * tl) {
+    dma_channel_config dc;
+
+    list = tl;
+
+    spi_init(TELEM_SPI, TELEM_SPI_HZ);
+    gpio_set_function(BOB_LORA_SCK, GPIO_FUNC_SPI);
+    gpio_set_function(BOB_LORA_MOSI, GPIO_FUNC_SPI);
+    gpio_set_function(BOB_LORA_MISO, GPIO_FUNC_SPI);
+
+    radio = SXInit(TELEM_SPI, BOB_LORA_CS, BOB_LORA_RESET);
+    if(SXBegin(&radio, TELEM_FREQ) != SX_OK)
+        return 1;
+
+    telemSetLink(0);
+
+    gpio_init(BOB_LORA_DIO0);
+    gpio_set_dir(BOB_LORA_DIO0, GPIO_IN);
+    gpio_set_irq_enabled_with_callback(BOB_LORA_DIO0, GPIO_IRQ_EDGE_RISE,
+                                       true, telemDio0IRQ);
+
+    // Bytes from the frame into the SPI TX FIFO, paced by the SPI
+    dmaChan = dma_claim_unused_channel(true);
+    dc = dma_channel_get_default_config(dmaChan);
+    channel_config_set_transfer_data_size(&dc, DMA_SIZE_8);
+    channel_config_set_dreq(&dc, spi_get_dreq(TELEM_SPI, true));
+    channel_config_set_read_increment(&dc, true);
+    channel_config_set_write_increment(&dc, false);
+    dma_channel_configure(dmaChan, &dc, &spi_get_hw(TELEM_SPI)->dr,
+                          &frame, sizeof(frame), false);
+
+    dma_channel_set_irq0_enabled(dmaChan, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, telemDmaIRQ);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    add_repeating_timer_ms(TELEM_TICK_MS, telemIRQ, NULL, &telemTimer);
+    return 0;
+}
+
+/* Gets the link's stats */
+void telemStats(telemStats_t * out) {
+    *out = stats;
+    out->link = link;
+    out->periodMs = periodMs;
+}
@@ -0,0 +1,68 @@
+#include "trace.h"
+
+#include <string.h>
+
+static traceStat_t stats[TR_IDS];
+static uint8_t depthMax[TQ_LISTS];
+
+static const char * const names[TR_IDS] = {
+    [TR_FTASK]    = "fTask",
+    [TR_IRQS_OFF] = "IRQs off",
+    [TR_QMI_TASK] = "qmiTask",
+    [TR_QMI_DONE] = "qmiDone",
+    [TR_HP_END]   = "hpEndTask",
+    [TR_HP_DONE]  = "hpEndDone",
+    [TR_DUMP]     = "dumpTask",
+    [TR_EST]      = "estImu"
+};
+
+/* ------------------ PUBLIC FUNCTIONS ------------------ */
+
+/* Records a section that started at start */
+void traceEnd(enum traceId id, uint32_t start) {
+    traceStat_t * s = &stats[id];
+    uint32_t us = time_us_32() - start;
+    uint32_t v = us / TRACE_MIN_US;
+    uint8_t b = 0;
+
+    // No CLZ on the M0+, and this is at most a few shifts
+    while(v && b < TRACE_BUCKETS - 1) {
+        v >>= 1;
+        b++;
+    }
+
+    if(!s->count || us < s->min)
+        s->min = us;
+    if(us > s->max)
+        s->max = us;
+    s->total += us;
+    s->count++;
+    s->hist[b]++;
+}
+
+/* Records a task list's depth */
+void traceDepth(enum traceList list, uint8_t depth) {
+    if(depth > depthMax[list])
+        depthMax[list] = depth;
+}
+
+/* Gets a copy of a section's stats */
+void traceGet(enum traceId id, traceStat_t * stat) {
+    *stat = stats[id];
+}
+
+/* Returns the deepest a task list has been */
+uint8_t traceDepthMax(enum traceList list) {
+    return depthMax[list];
+}
+
+/* Returns the name of a section, for printing */
+const char * traceName(enum traceId id) {
+    return names[id];
+}
+
+/* Clears everything */
+void traceReset(void) {
+    memset(stats, 0, sizeof(stats));
+    memset(depthMax, 0, sizeof(depthMax));
+}
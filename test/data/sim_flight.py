@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""Writes a simulated flight in the shell's CSV dump format, for the replay
+test. Only the sensor columns are meaningful, in the logged units (cm/s^2
+and centidegrees/s); acc filt and delta are left at 0, as the replay
+recomputes them.
+
+    test/data/sim_flight.py > test/data/sim_flight.csv
+
+Pad for 2 s, 1.2 s burn at 6 g, coast to apogee, drogue at 25 m/s down to
+60 m, main at 6 m/s, then sat on the ground. mainPres for this flight is
+MAIN_PRES."""
+
+import math
+import random
+
+IMU_MS = 20         # 50 Hz, the detector doesnt need more
+BARO_MS = 50        # HP_PERIOD_MS
+G = 9.81
+G_CMSS = 981        # types.h
+P0 = 101325
+MAIN_ALT = 60
+MAIN_PRES = 100606
+
+
+def pressure(h):
+    return P0 * (1 - 2.25577e-5 * h) ** 5.25588
+
+
+def main():
+    rnd = random.Random(1)
+    dt = 0.001
+    t = 0.0
+    h = v = 0.0
+    phase = "pad"
+    landed = None
+    out = ["IMU, time, acc x, acc y, acc z, acc filt, gyro x, gyro y, gyro z",
+           "BARO, time, pres, temp, delta"]
+
+    for ms in range(0, 34000):
+        t = ms / 1000
+        # Specific force along the body, in g
+        if phase == "pad":
+            force = 1.0
+            if t >= 2.0:
+                phase = "boost"
+        if phase == "boost":
+            a = 6 * G
+            force = 6 + 1.0
+            if t >= 3.2:
+                phase = "coast"
+        if phase == "coast":
+            a = -G - 0.002 * v * abs(v)
+            force = -0.002 * v * abs(v) / G
+            if v <= 0:
+                phase = "drogue"
+                deploy = t
+        if phase == "drogue":
+            # Settles onto 25 m/s down
+            a = (-25 - v) * 2
+            force = 1.0 + a / G + (4 if t - deploy < 0.1 else 0)
+            if h <= MAIN_ALT:
+                phase = "main"
+                deploy = t
+        if phase == "main":
+            a = (-6 - v) * 3
+            force = 1.0 + a / G + (3 if t - deploy < 0.1 else 0)
+            if h <= 0:
+                phase = "ground"
+        if phase == "ground":
+            a = v = 0.0
+            h = 0.0
+            force = 1.0
+
+        if phase not in ("pad", "ground"):
+            v += a * dt
+            h = max(h + v * dt, 0)
+
+        if ms % IMU_MS == 0:
+            acc = [rnd.randint(-20, 20), rnd.randint(-20, 20),
+                   int(force * G_CMSS) + rnd.randint(-20, 20)]
+            gyro = [rnd.randint(-15, 15) for _ in range(3)]
+            out.append("IMU, %u, %d, %d, %d, 0, %d, %d, %d"
+                       % (ms, *acc, *gyro))
+        if ms % BARO_MS == 0:
+            pres = int(pressure(h)) + rnd.randint(-3, 3)
+            out.append("BARO, %u, %u, %d, 0" % (ms, pres, 2000 - int(h / 10)))
+
+    print("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,20 @@
+#ifndef MOCK_HARDWARE_FLASH_H
+#define MOCK_HARDWARE_FLASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mock.h"
+
+#define FLASH_PAGE_SIZE   (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define FLASH_BLOCK_SIZE  (1u << 16)
+
+// The XIP window is the mock's flash array
+#define XIP_BASE                 ((uintptr_t) mockFlash)
+#define XIP_NOCACHE_NOALLOC_BASE XIP_BASE
+
+void flash_range_program(uint32_t offs, const uint8_t * data, size_t count);
+void flash_range_erase(uint32_t offs, size_t count);
+
+#endif
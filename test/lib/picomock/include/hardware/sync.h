@@ -0,0 +1,14 @@
+#ifndef MOCK_HARDWARE_SYNC_H
+#define MOCK_HARDWARE_SYNC_H
+
+#include <stdint.h>
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+static inline void __dmb(void) {}
+static inline void __wfi(void) {}
+static inline void __wfe(void) {}
+static inline void __sev(void) {}
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef MOCK_HARDWARE_TIMER_H
+#define MOCK_HARDWARE_TIMER_H
+
+#include "pico/stdlib.h"
+
+#endif
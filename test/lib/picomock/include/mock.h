@@ -0,0 +1,38 @@
+#ifndef MOCK_H
+#define MOCK_H
+
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+
+/* Controls for the mocked pico SDK.
+ *
+ * Time only moves when mockAdvanceUs says so, and repeating timers fire
+ * from inside it, in order, as their time comes up. The flash is a RAM
+ * array standing in for the memory mapped XIP flash; programming it checks
+ * alignment and only ever clears bits, like the real thing. The I2C bus has
+ * nothing on it, and the I2C queue just accepts transactions. */
+
+#define MOCK_FLASH_SIZE (8 * 1024 * 1024)
+#define MOCK_TIMERS     16
+
+extern uint8_t mockFlash[MOCK_FLASH_SIZE] __attribute__((aligned(4096)));
+
+/* Erases the flash, stops every timer and sets the time back to 0 */
+void mockReset(void);
+
+/* Stops every timer, like a reset of the board. The flash and the time
+ * are left alone; the firmware's own statics are up to the test. */
+void mockReboot(void);
+
+/* Moves time on by us, firing any timers that come due */
+void mockAdvanceUs(uint64_t us);
+
+/* Pages programmed and sectors erased since mockReset */
+uint32_t mockPrograms(void);
+uint32_t mockErases(void);
+
+/* Programs or erases that broke the flash's rules since mockReset */
+uint32_t mockFlashFaults(void);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef MOCK_PICO_STDLIB_H
+#define MOCK_PICO_STDLIB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#define PICO_ERROR_TIMEOUT -1
+#define PICO_ERROR_GENERIC -2
+
+#define __not_in_flash_func(f) f
+#define __time_critical_func(f) f
+
+/* Time */
+typedef uint64_t absolute_time_t;
+
+absolute_time_t get_absolute_time(void);
+uint32_t to_ms_since_boot(absolute_time_t t);
+uint64_t to_us_since_boot(absolute_time_t t);
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+
+/* Timers */
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t * rt);
+typedef struct alarm_pool alarm_pool_t;
+
+struct repeating_timer {
+    int64_t delay_us;
+    void * user_data;
+    repeating_timer_callback_t callback;
+    alarm_pool_t * pool;
+    int32_t alarm_id;
+};
+
+bool add_repeating_timer_ms(int32_t ms, repeating_timer_callback_t cb,
+                            void * data, repeating_timer_t * rt);
+bool add_repeating_timer_us(int64_t us, repeating_timer_callback_t cb,
+                            void * data, repeating_timer_t * rt);
+bool alarm_pool_add_repeating_timer_ms(alarm_pool_t * pool, int32_t ms,
+                                       repeating_timer_callback_t cb,
+                                       void * data, repeating_timer_t * rt);
+bool alarm_pool_add_repeating_timer_us(alarm_pool_t * pool, int64_t us,
+                                       repeating_timer_callback_t cb,
+                                       void * data, repeating_timer_t * rt);
+bool cancel_repeating_timer(repeating_timer_t * rt);
+alarm_pool_t * alarm_pool_get_default(void);
+alarm_pool_t * alarm_pool_create(uint alarm, uint max);
+
+/* GPIO */
+#define GPIO_IN  false
+#define GPIO_OUT true
+
+enum gpio_function {
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_UART = 2,
+    GPIO_FUNC_I2C = 3
+};
+
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+void gpio_pull_up(uint gpio);
+
+/* Misc */
+uint get_core_num(void);
+bool stdio_init_all(void);
+int getchar_timeout_us(uint32_t us);
+
+static inline void tight_loop_contents(void) {}
+
+#endif
@@ -0,0 +1,16 @@
+#include "taskList.h"
+#include "types.h"
+
+/* Stands in for the globals in src/main.c */
+
+enum states state = BOOT;
+
+baro_t baroData = {0};
+imu_t  imuData = {0};
+comp_t compData = {0};
+gps_t  gpsData = {0};
+
+conf_t config = {0};
+
+taskList_t tl;
+taskList_t * sensorTl = &tl;
@@ -0,0 +1,284 @@
+#include "mock.h"
+#include "hardware/flash.h"
+#include "hardware/i2c.h"
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+
+#include <string.h>
+
+// Sector aligned, as the flash code works out pages from the address
+uint8_t mockFlash[MOCK_FLASH_SIZE] __attribute__((aligned(4096)));
+
+static uint64_t nowUs = 0;
+
+typedef struct {
+    repeating_timer_t * rt;
+    uint64_t next;
+} mockTimer_t;
+
+static mockTimer_t timers[MOCK_TIMERS];
+
+static uint32_t programs, erases, faults;
+
+// Something for the instance pointers to point at
+static uint8_t i2cInsts[2];
+i2c_inst_t * const i2c0 = (i2c_inst_t * ) &i2cInsts[0];
+i2c_inst_t * const i2c1 = (i2c_inst_t * ) &i2cInsts[1];
+
+/* ---------------------- CONTROLS ---------------------- */
+
+/* Erases the flash, stops every timer and sets the time back to 0 */
+void mockReset(void) {
+    memset(mockFlash, 0xFF, sizeof(mockFlash));
+    memset(timers, 0, sizeof(timers));
+    nowUs = 0;
+    programs = 0;
+    erases = 0;
+    faults = 0;
+}
+
+/* Stops every timer, like a reset of the board. The flash and the time
+ * are left alone. */
+void mockReboot(void) {
+    memset(timers, 0, sizeof(timers));
+}
+
+/* Moves time on by us, firing any timers that come due */
+void mockAdvanceUs(uint64_t us) {
+    uint64_t end = nowUs + us;
+    mockTimer_t * next;
+    int i;
+
+    while(true) {
+        // Earliest timer due before the end
+        next = NULL;
+        for(i = 0; i < MOCK_TIMERS; i++) {
+            if(timers[i].rt && timers[i].next <= end
+            && (!next || timers[i].next < next->next))
+                next = &timers[i];
+        }
+        if(!next)
+            break;
+
+        nowUs = next->next;
+        if(next->rt->callback(next->rt)) {
+            next->next += next->rt->delay_us;
+        } else {
+            next->rt = NULL;
+        }
+    }
+
+    nowUs = end;
+}
+
+uint32_t mockPrograms(void) {
+    return programs;
+}
+
+uint32_t mockErases(void) {
+    return erases;
+}
+
+uint32_t mockFlashFaults(void) {
+    return faults;
+}
+
+/* ------------------------ TIME ------------------------ */
+
+absolute_time_t get_absolute_time(void) {
+    return nowUs;
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t) {
+    return t / 1000;
+}
+
+uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+uint64_t time_us_64(void) {
+    return nowUs;
+}
+
+uint32_t time_us_32(void) {
+    return nowUs;
+}
+
+// Sleeping just moves time on. Timers still fire, like IRQs would.
+void sleep_ms(uint32_t ms) {
+    mockAdvanceUs((uint64_t) ms * 1000);
+}
+
+void sleep_us(uint64_t us) {
+    mockAdvanceUs(us);
+}
+
+/* ----------------------- TIMERS ----------------------- */
+
+bool add_repeating_timer_us(int64_t us, repeating_timer_callback_t cb,
+                            void * data, repeating_timer_t * rt) {
+    int i;
+
+    for(i = 0; i < MOCK_TIMERS && timers[i].rt; i++);
+    if(i == MOCK_TIMERS)
+        return false;
+
+    // The SDK takes negative delays as start to start; its all the same here
+    rt->delay_us = us < 0 ? -us : us;
+    rt->callback = cb;
+    rt->user_data = data;
+    timers[i].rt = rt;
+    timers[i].next = nowUs + rt->delay_us;
+    return true;
+}
+
+bool add_repeating_timer_ms(int32_t ms, repeating_timer_callback_t cb,
+                            void * data, repeating_timer_t * rt) {
+    return add_repeating_timer_us((int64_t) ms * 1000, cb, data, rt);
+}
+
+bool alarm_pool_add_repeating_timer_us(alarm_pool_t * pool, int64_t us,
+                                       repeating_timer_callback_t cb,
+                                       void * data, repeating_timer_t * rt) {
+    return add_repeating_timer_us(us, cb, data, rt);
+}
+
+bool alarm_pool_add_repeating_timer_ms(alarm_pool_t * pool, int32_t ms,
+                                       repeating_timer_callback_t cb,
+                                       void * data, repeating_timer_t * rt) {
+    return add_repeating_timer_ms(ms, cb, data, rt);
+}
+
+bool cancel_repeating_timer(repeating_timer_t * rt) {
+    int i;
+
+    for(i = 0; i < MOCK_TIMERS; i++) {
+        if(timers[i].rt == rt) {
+            timers[i].rt = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+alarm_pool_t * alarm_pool_get_default(void) {
+    return NULL;
+}
+
+alarm_pool_t * alarm_pool_create(uint alarm, uint max) {
+    return NULL;
+}
+
+/* ------------------------ FLASH ----------------------- */
+
+void flash_range_program(uint32_t offs, const uint8_t * data, size_t count) {
+    size_t i;
+
+    if(offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE
+    || offs + count > MOCK_FLASH_SIZE) {
+        faults++;
+        return;
+    }
+
+    // Programming can only clear bits. 0xFF is how the firmware leaves a
+    // byte alone, so only complain about bits it wanted set that cant be.
+    for(i = 0; i < count; i++) {
+        if(data[i] != 0xFF && (mockFlash[offs + i] & data[i]) != data[i])
+            faults++;
+        mockFlash[offs + i] &= data[i];
+    }
+    programs += count / FLASH_PAGE_SIZE;
+}
+
+void flash_range_erase(uint32_t offs, size_t count) {
+    if(offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE
+    || offs + count > MOCK_FLASH_SIZE) {
+        faults++;
+        return;
+    }
+
+    memset(&mockFlash[offs], 0xFF, count);
+    erases += count / FLASH_SECTOR_SIZE;
+}
+
+/* --------------------- INTERRUPTS --------------------- */
+
+// Nothing preempts anything on the host
+uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+void restore_interrupts(uint32_t status) {
+}
+
+void multicore_lockout_victim_init(void) {
+}
+
+void multicore_lockout_start_blocking(void) {
+}
+
+void multicore_lockout_end_blocking(void) {
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+}
+
+/* ------------------------- I2C ------------------------ */
+
+// Theres nothing on the bus
+uint i2c_init(i2c_inst_t * i2c, uint baudrate) {
+    return baudrate;
+}
+
+int i2c_write_blocking(i2c_inst_t * i2c, uint8_t addr, const uint8_t * src,
+                       size_t len, bool nostop) {
+    return PICO_ERROR_GENERIC;
+}
+
+int i2c_read_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst,
+                      size_t len, bool nostop) {
+    return PICO_ERROR_GENERIC;
+}
+
+int i2c_write_timeout_per_char_us(i2c_inst_t * i2c, uint8_t addr,
+                                  const uint8_t * src, size_t len,
+                                  bool nostop, uint us) {
+    return PICO_ERROR_GENERIC;
+}
+
+int i2c_read_timeout_per_char_us(i2c_inst_t * i2c, uint8_t addr,
+                                 uint8_t * dst, size_t len,
+                                 bool nostop, uint us) {
+    return PICO_ERROR_GENERIC;
+}
+
+/* ------------------------ MISC ------------------------ */
+
+void gpio_init(uint gpio) {
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+}
+
+void gpio_put(uint gpio, bool value) {
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+}
+
+void gpio_pull_up(uint gpio) {
+}
+
+uint get_core_num(void) {
+    return 0;
+}
+
+bool stdio_init_all(void) {
+    return true;
+}
+
+int getchar_timeout_us(uint32_t us) {
+    return PICO_ERROR_TIMEOUT;
+}
@@ -0,0 +1,141 @@
+#include <unity.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "flash.h"
+#include "mock.h"
+#include "taskList.h"
+#include "types.h"
+
+/* Packing benchmarks. Pushes a stream of records the way the sampler does
+ * in flight, with fTask run off its own timer, and reports how many records
+ * the host packs per second and how many fit in a page.
+ *
+ * Records per page is the same on the board, so it is checked against a
+ * floor to catch format regressions. Host speed only means anything
+ * relative to another run on the same machine. */
+
+#define BENCH_SECONDS 30
+#define BENCH_IMU_HZ  1000
+#define BENCH_BARO_HZ 20
+
+// Regression floors for records per page. The smooth stream is what DELTA
+// records are for; the noisy one mostly stores keyframes.
+#define BENCH_SMOOTH_MIN 14.0
+#define BENCH_NOISY_MIN  8.0
+
+extern enum states state;
+extern taskList_t tl;
+
+typedef struct {
+    uint32_t records;
+    uint32_t bytes;       // As pushed, with headers
+    uint32_t pages;
+    double hostS;
+} bench_t;
+
+/* ---------------------- HELPERS ----------------------- */
+
+static void runTasks(void) {
+    while(!tlRun(&tl));
+}
+
+/* Pushes BENCH_SECONDS of IMU and baro. noise is the size of the random
+ * part of each reading. */
+static bench_t benchRun(int noise) {
+    bench_t b = {0};
+    struct timespec start, end;
+    conf_t cfg = {0};
+    uint32_t ms;
+    int i;
+
+    mockReset();
+    srand(1);
+    tl = tlInit();
+    fInit(&cfg);
+    state = BOOST;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(ms = 0; ms < BENCH_SECONDS * 1000; ms++) {
+        for(i = 0; i < BENCH_IMU_HZ / 1000; i++) {
+            imu_t imu = {.time = ms};
+            imu.accl[0] = 2048 + ms % 512 + rand() % (noise + 1);
+            imu.accl[1] = -100 + rand() % (noise + 1);
+            imu.accl[2] = 50 + rand() % (noise + 1);
+            imu.gyro[0] = rand() % (noise + 1);
+            imu.gyro[1] = ms / 100 + rand() % (noise + 1);
+            imu.gyro[2] = rand() % (noise + 1);
+            imu.acclFilt = 2100 + ms % 512;
+            fPush(&imu, sizeof(imu), IMU);
+            b.records++;
+            b.bytes += sizeof(imu) + 3;
+        }
+        if(ms % (1000 / BENCH_BARO_HZ) == 0) {
+            baro_t baro = {.time = ms, .pres = 100000 - ms / 10,
+                           .temp = 2000, .vVel = -20};
+            fPush(&baro, sizeof(baro), BARO);
+            b.records++;
+            b.bytes += sizeof(baro) + 3;
+        }
+
+        mockAdvanceUs(1000);
+        runTasks();
+    }
+
+    // Let it catch up
+    for(i = 0; i < 100; i++) {
+        mockAdvanceUs(10000);
+        runTasks();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    b.pages = mockPrograms();
+    b.hostS = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return b;
+}
+
+static void benchReport(const char * name, bench_t * b) {
+    char msg[200];
+
+    snprintf(msg, sizeof(msg),
+             "%s: %u records, %.0f records/s on the host, %u pages, "
+             "%.1f records/page, %.0f pushed bytes/page",
+             name, b->records, b->records / b->hostS, b->pages,
+             (double) b->records / b->pages, (double) b->bytes / b->pages);
+    TEST_MESSAGE(msg);
+}
+
+/* ------------------------ TESTS ----------------------- */
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static void testSmooth(void) {
+    bench_t b = benchRun(3);
+
+    benchReport("smooth", &b);
+    TEST_ASSERT_EQUAL_UINT32(0, fDropped());
+    TEST_ASSERT_EQUAL_UINT32(0, mockFlashFaults());
+    TEST_ASSERT_TRUE((double) b.records / b.pages >= BENCH_SMOOTH_MIN);
+}
+
+static void testNoisy(void) {
+    bench_t b = benchRun(2000);
+
+    benchReport("noisy", &b);
+    TEST_ASSERT_EQUAL_UINT32(0, fDropped());
+    TEST_ASSERT_EQUAL_UINT32(0, mockFlashFaults());
+    TEST_ASSERT_TRUE((double) b.records / b.pages >= BENCH_NOISY_MIN);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(testSmooth);
+    RUN_TEST(testNoisy);
+    return UNITY_END();
+}
@@ -0,0 +1,70 @@
+#include <unity.h>
+
+#include <string.h>
+
+#include "calib.h"
+
+/* Calibration tables and fixed point conversion */
+
+// 16 g accelerometer: 2048 counts per g, about 0.479 cm/s^2 per count
+#define UNITS 1961
+
+static cal_t cal;
+static calTable_t table;
+
+void setUp(void) {
+    memset(&cal, 0, sizeof(cal));
+}
+
+void tearDown(void) {
+}
+
+static void testUnits(void) {
+    const int16_t raw[3] = {2048, -2048, 0};
+    int16_t out[3];
+
+    calBuild(&table, &cal, UNITS);
+    calApply(&table, raw, out);
+
+    TEST_ASSERT_INT16_WITHIN(1, G_CMSS, out[0]);
+    TEST_ASSERT_INT16_WITHIN(1, -G_CMSS, out[1]);
+    TEST_ASSERT_EQUAL_INT16(0, out[2]);
+}
+
+static void testOffsetAndScale(void) {
+    const int16_t raw[3] = {2048, 2048, 2048};
+    int16_t out[3];
+
+    // x reads 10 high, y 1% low, and z picks up a quarter of x
+    cal.offset[0] = 10;
+    cal.scale[1][1] = (1 << CAL_SCALE_Q) / 100;
+    cal.scale[2][0] = (1 << CAL_SCALE_Q) / 4;
+    calBuild(&table, &cal, UNITS);
+    calApply(&table, raw, out);
+
+    TEST_ASSERT_INT16_WITHIN(1, G_CMSS - 10, out[0]);
+    TEST_ASSERT_INT16_WITHIN(2, G_CMSS * 101 / 100, out[1]);
+    TEST_ASSERT_INT16_WITHIN(2, G_CMSS * 5 / 4, out[2]);
+}
+
+static void testSaturates(void) {
+    const int16_t raw[3] = {INT16_MAX, INT16_MIN, 0};
+    int16_t out[3];
+
+    // Twice the scale pushes full scale past int16
+    cal.scale[0][0] = 1 << CAL_SCALE_Q;
+    cal.scale[1][1] = 1 << CAL_SCALE_Q;
+    calBuild(&table, &cal, 1 << (CAL_Q + 1));
+    calApply(&table, raw, out);
+
+    TEST_ASSERT_EQUAL_INT16(INT16_MAX, out[0]);
+    TEST_ASSERT_EQUAL_INT16(INT16_MIN, out[1]);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(testUnits);
+    RUN_TEST(testOffsetAndScale);
+    RUN_TEST(testSaturates);
+    return UNITY_END();
+}
@@ -0,0 +1,113 @@
+#include <unity.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "estimator.h"
+
+/* Attitude and altitude estimation, off clean synthetic sensors */
+
+#define DT_US  1000        // 1 kHz IMU
+#define Q14    16384
+
+// Pressures 100 m apart, near the ground
+#define PAD_PRES  101325
+#define HIGH_PRES 100129
+
+static const int16_t level[3] = {0, 0, G_CMSS};
+static const int16_t still[3] = {0, 0, 0};
+
+void setUp(void) {
+    estInit(DT_US);
+}
+
+void tearDown(void) {
+}
+
+/* Runs n IMU samples of the same reading */
+static void run(const int16_t accl[3], const int16_t gyro[3], int n) {
+    while(n--)
+        estImu(accl, gyro);
+}
+
+static void testPrimesOffGravity(void) {
+    const int16_t side[3] = {G_CMSS, 0, 0};
+    est_t e;
+
+    // On its side, so up is along x: a quarter turn about y
+    run(side, still, 1);
+    e = estGet(0);
+
+    TEST_ASSERT_INT16_WITHIN(20, Q14 * M_SQRT1_2, e.quat[0]);
+    TEST_ASSERT_INT16_WITHIN(20, 0, e.quat[1]);
+    TEST_ASSERT_INT16_WITHIN(20, -Q14 * M_SQRT1_2, e.quat[2]);
+    TEST_ASSERT_INT16_WITHIN(20, 0, e.quat[3]);
+}
+
+static void testGyro(void) {
+    const int16_t spin[3] = {0, 0, 9000};
+    est_t e;
+
+    // 90 degrees a second about up for a second
+    run(level, still, 1);
+    run(level, spin, 1000);
+    e = estGet(0);
+
+    TEST_ASSERT_INT16_WITHIN(60, Q14 * M_SQRT1_2, e.quat[0]);
+    TEST_ASSERT_INT16_WITHIN(20, 0, e.quat[1]);
+    TEST_ASSERT_INT16_WITHIN(20, 0, e.quat[2]);
+    TEST_ASSERT_INT16_WITHIN(60, Q14 * M_SQRT1_2, e.quat[3]);
+}
+
+static void testCompassOnlyYaws(void) {
+    // Level, with north along the body's y and dipping down
+    const int16_t mag[3] = {0, 2000, -4000};
+    est_t e;
+    int i;
+
+    run(level, still, 1);
+    for(i = 0; i < 20000; i++) {
+        estComp(mag);
+        estImu(level, still);
+    }
+    e = estGet(0);
+
+    // A quarter turn about up, and no tilt at all
+    TEST_ASSERT_INT16_WITHIN(60, Q14 * M_SQRT1_2, abs(e.quat[0]));
+    TEST_ASSERT_INT16_WITHIN(2, 0, e.quat[1]);
+    TEST_ASSERT_INT16_WITHIN(2, 0, e.quat[2]);
+    TEST_ASSERT_INT16_WITHIN(60, Q14 * M_SQRT1_2, abs(e.quat[3]));
+}
+
+static void testAltitude(void) {
+    est_t e;
+    int i;
+
+    // Sat on the pad, then the baro jumps up 100 m
+    estBaro(PAD_PRES, true);
+    for(i = 0; i < 400; i++) {
+        run(level, still, 50);
+        estBaro(i < 100 ? PAD_PRES : HIGH_PRES, i < 100);
+    }
+    e = estGet(0);
+
+    TEST_ASSERT_INT_WITHIN(50, 10000, e.alt);
+    TEST_ASSERT_INT_WITHIN(2, 0, e.vVel);
+}
+
+static void testPresAbove(void) {
+    // The same 100 m the other way round, and nothing at all
+    TEST_ASSERT_INT_WITHIN(5, HIGH_PRES, estPresAbove(PAD_PRES, 10000));
+    TEST_ASSERT_INT_WITHIN(1, PAD_PRES, estPresAbove(PAD_PRES, 0));
+    TEST_ASSERT_INT_WITHIN(5, PAD_PRES, estPresAbove(HIGH_PRES, -10000));
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(testPrimesOffGravity);
+    RUN_TEST(testGyro);
+    RUN_TEST(testCompassOnlyYaws);
+    RUN_TEST(testAltitude);
+    RUN_TEST(testPresAbove);
+    return UNITY_END();
+}
@@ -0,0 +1,94 @@
+#include <unity.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "filter.h"
+
+/* Filter benchmarks. Runs the sampler's own filters over a long stream and
+ * reports the host's ns per step, after checking they still filter.
+ *
+ * Like test_bench, host speed only means anything relative to another run
+ * on the same machine. */
+
+#define FILTER_STEPS 10000000
+
+// The sampler's filters, see src/sampler.c
+static const biquad_t baroVel = {.b = {160, 0, -160}, .a = {-112, 49},
+                                 .shift = 8};
+#define ACCL_AVG 3
+
+// Keeps the compiler from throwing the work away
+static volatile int32_t sink;
+
+/* ---------------------- HELPERS ----------------------- */
+
+static double hostS(const struct timespec * start) {
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return end.tv_sec - start->tv_sec + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void report(const char * name, double s) {
+    char msg[120];
+
+    snprintf(msg, sizeof(msg), "%s: %.1f ns/step on the host", name,
+             s * 1e9 / FILTER_STEPS);
+    TEST_MESSAGE(msg);
+}
+
+/* ------------------------ TESTS ----------------------- */
+
+void setUp(void) {
+    srand(1);
+}
+
+void tearDown(void) {
+}
+
+static void testBiquad(void) {
+    biquadState_t st;
+    struct timespec start;
+    int32_t y = 0;
+    int i;
+
+    // A difference filter, so a steady baro reads no speed at all
+    biquadReset(&st);
+    for(i = 0; i < 100; i++)
+        y = biquadStep(&baroVel, &st, 101325);
+    TEST_ASSERT_EQUAL_INT32(0, y);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < FILTER_STEPS; i++)
+        y += biquadStep(&baroVel, &st, 100000 + (i & 1023));
+    sink = y;
+    report("biquadStep", hostS(&start));
+}
+
+static void testMovAvg(void) {
+    movAvg_t ma;
+    int32_t buf[1 << ACCL_AVG];
+    struct timespec start;
+    int32_t y = 0;
+    int i;
+
+    maInit(&ma, buf, ACCL_AVG);
+    for(i = 0; i < 100; i++)
+        y = maStep(&ma, 981);
+    TEST_ASSERT_EQUAL_INT32(981, y);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < FILTER_STEPS; i++)
+        y += maStep(&ma, 981 + (i & 1023));
+    sink = y;
+    report("maStep", hostS(&start));
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(testBiquad);
+    RUN_TEST(testMovAvg);
+    return UNITY_END();
+}
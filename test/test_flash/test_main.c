@@ -0,0 +1,149 @@
+#include <unity.h>
+
+#include <string.h>
+
+#include "flash.h"
+#include "mock.h"
+#include "taskList.h"
+#include "types.h"
+
+/* The flash log across a reboot in the middle of a wipe. Each flight's
+ * records carry its own marker in gyro[0], so whats read back can be told
+ * apart. */
+
+#define OLD_FLIGHT   1
+#define NEW_FLIGHT   2
+#define LATER_FLIGHT 3
+
+#define OLD_RECORDS  20000     // About 80 sectors
+#define NEW_RECORDS  500       // Well inside what the wipe gets through
+#define PER_MS       10
+
+extern enum states state;
+extern taskList_t tl;
+
+static conf_t cfg;
+
+// Records of each flight read back
+static uint32_t seen[4];
+static uint32_t backwards;
+
+/* ---------------------- HELPERS ----------------------- */
+
+static void runTasks(void) {
+    while(!tlRun(&tl));
+}
+
+/* Logs a flight, PER_MS records a ms. Runs at most tasksPerMs tasks each
+ * ms, or everything if its 0. */
+static void flight(int16_t marker, uint32_t records, int tasksPerMs) {
+    uint32_t i;
+    int t;
+
+    for(i = 0; i < records; i++) {
+        imu_t imu = {.time = time_us_32() / 1000, .gyro = {marker, 0, 0}};
+        imu.accl[2] = i;
+        fPush(&imu, sizeof(imu), IMU);
+
+        if(i % PER_MS == PER_MS - 1) {
+            mockAdvanceUs(1000);
+            if(!tasksPerMs)
+                runTasks();
+            for(t = 0; t < tasksPerMs; t++)
+                tlRun(&tl);
+        }
+    }
+}
+
+/* Counts whats in the log */
+static void readBack(void) {
+    log_t l;
+    uint32_t last = 0;
+
+    memset(seen, 0, sizeof(seen));
+    backwards = 0;
+    fRewind();
+    while(!fRead(&l)) {
+        if(l.type != IMU || l.data.imu.gyro[0] > LATER_FLIGHT)
+            continue;
+        seen[l.data.imu.gyro[0]]++;
+        if(l.data.imu.time < last)
+            backwards++;
+        last = l.data.imu.time;
+    }
+}
+
+/* Reboots the board, as far as the flash log can tell */
+static void reboot(void) {
+    mockReboot();
+    tl = tlInit();
+    fInit(&cfg);
+}
+
+/* ------------------------ TESTS ----------------------- */
+
+void setUp(void) {
+    mockReset();
+    tl = tlInit();
+    state = BOOST;
+    fInit(&cfg);
+}
+
+void tearDown(void) {
+}
+
+static void testWipeResumes(void) {
+    uint32_t kept;
+
+    flight(OLD_FLIGHT, OLD_RECORDS, 0);
+    fEndSession();
+
+    // Wipe, and log a short flight while its still going
+    fErase();
+    flight(NEW_FLIGHT, NEW_RECORDS, 1);
+    TEST_ASSERT_TRUE(fEraseProgress() < 100);
+
+    reboot();
+    readBack();
+    kept = seen[NEW_FLIGHT];
+    TEST_ASSERT_EQUAL_UINT32(0, seen[OLD_FLIGHT]);
+    TEST_ASSERT_NOT_EQUAL(0, kept);
+    TEST_ASSERT_EQUAL_UINT32(0, backwards);
+    TEST_ASSERT_EQUAL_INT(1, fSessions());
+
+    // Let the wipe finish, then fly again
+    TEST_ASSERT_TRUE(fEraseProgress() < 100);
+    runTasks();
+    TEST_ASSERT_EQUAL_INT(100, fEraseProgress());
+    flight(LATER_FLIGHT, NEW_RECORDS, 0);
+    fEndSession();
+
+    readBack();
+    TEST_ASSERT_EQUAL_UINT32(0, seen[OLD_FLIGHT]);
+    TEST_ASSERT_EQUAL_UINT32(kept, seen[NEW_FLIGHT]);
+    TEST_ASSERT_EQUAL_UINT32(NEW_RECORDS, seen[LATER_FLIGHT]);
+    TEST_ASSERT_EQUAL_UINT32(0, backwards);
+    TEST_ASSERT_EQUAL_INT(2, fSessions());
+    TEST_ASSERT_EQUAL_UINT32(0, mockFlashFaults());
+
+    // A finished wipe isnt resumed
+    reboot();
+    TEST_ASSERT_EQUAL_INT(100, fEraseProgress());
+}
+
+static void testRebootKeepsLog(void) {
+    flight(OLD_FLIGHT, NEW_RECORDS, 0);
+    fEndSession();
+
+    reboot();
+    readBack();
+    TEST_ASSERT_EQUAL_UINT32(NEW_RECORDS, seen[OLD_FLIGHT]);
+    TEST_ASSERT_EQUAL_INT(100, fEraseProgress());
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(testWipeResumes);
+    RUN_TEST(testRebootKeepsLog);
+    return UNITY_END();
+}
@@ -0,0 +1,395 @@
+#include <unity.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mock.h"
+
+// The processors, rates and I2C callbacks are all static
+#include "../../src/sampler.c"
+
+/* Replays a flight CSV through the sampler's I2C callbacks, the detector
+ * and the flash log, with fTask driven off its own timer, then reads the
+ * log back.
+ *
+ * The CSV is in the same format as the shell's dump; only the IMU and
+ * baro sensor columns are used, so any dump (or tools/bobdump.py output)
+ * works. IMU readings are turned back into counts for the sampler to
+ * convert again, so a board's own dump replays best with its calibration
+ * left out.
+ * Set BOB_REPLAY to replay something other than the simulated flight,
+ * BOB_MAIN_PRES for its main deployment pressure and BOB_IMU_US for its
+ * IMU period. Only the sim flight is checked against its known states and
+ * burnout speed. */
+
+#define REPLAY_CSV       "test/data/sim_flight.csv"
+#define REPLAY_MAIN_PRES 100606    // MAIN_PRES in sim_flight.py
+#define REPLAY_STATES    "gBcdDmMG"
+#define REPLAY_TAIL_MS   (F_LANDED_MS + 2000)  // Left to run after the end,
+                                               // so the session gets closed
+#define REPLAY_IMU_US    20000     // IMU_MS in sim_flight.py
+#define REPLAY_BURNOUT   706       // dm/s, 6 g for 1.2 s
+
+// The estimate has to stay within 5 degrees of upright, as the sim never
+// turns, and get apogee to within 5% of the baro's
+#define EST_UPRIGHT      16368     // cos(2.5 degrees) in Q14
+
+extern taskList_t tl;
+extern conf_t config;
+
+static struct {
+    bool sim;
+    uint32_t imu, baro;            // Samples replayed
+    char states[16];               // States entered, in order
+    uint8_t nStates;
+    uint32_t fullFrom, fullTo;     // When every sample should be logged
+    uint32_t fullImu;              // IMU samples replayed in that window
+    uint32_t landedAt;             // When it landed
+    uint32_t landedImu;            // IMU samples replayed after that
+    uint32_t groundPres;           // First baro sample
+    int32_t apogee;                // Highest the baro went, cm
+    double hostS;                  // Host time spent replaying
+} rp;
+
+// Read back from the flash
+static struct {
+    uint32_t imu, baro, events, other;
+    uint32_t fullImu;
+    uint32_t landedImu;
+    uint32_t lastImu;
+    uint32_t imuBackwards;
+    uint32_t est;
+    int32_t estApogee, estVelMax;
+    int16_t estQ0Min;
+    char states[16];
+    uint8_t nStates;
+} rb;
+
+/* ---------------------- HELPERS ----------------------- */
+
+/* Runs everything queued, like main's loop */
+static void runTasks(void) {
+    do {
+        traceDepth(TQ_MAIN, tlSize(&tl));
+    } while(!tlRun(&tl));
+}
+
+/* Moves time on to ms, running tasks as timers fire */
+static void advanceTo(uint32_t ms) {
+    uint64_t target = (uint64_t) ms * 1000;
+
+    while(time_us_64() < target) {
+        mockAdvanceUs(MIN(1000, target - time_us_64()));
+        runTasks();
+    }
+}
+
+/* Keeps track of the states entered */
+static void noteState(void) {
+    if(rp.nStates && rp.states[rp.nStates - 1] == state)
+        return;
+    if(rp.nStates < sizeof(rp.states) - 1)
+        rp.states[rp.nStates++] = state;
+}
+
+/* Hands a baro sample over the way the I2C queue would */
+static void injectBaro(uint32_t pres, int32_t temp) {
+    hpBuf[0] = temp >> 16;
+    hpBuf[1] = temp >> 8;
+    hpBuf[2] = temp;
+    hpBuf[3] = pres >> 16;
+    hpBuf[4] = pres >> 8;
+    hpBuf[5] = pres;
+    hpEndTxn.status = IQ_OK;
+    hpEndTxn.doneUs = time_us_32();
+    tlAddPrio(&tl, TL_HIGH, hpEndTxn.callback, &hpEndTxn);
+    runTasks();
+}
+
+/* Hands a single frame IMU read over the way the I2C queue would. The
+ * readings are in the logged units, so turn them back into counts. */
+static void injectImu(const int16_t accl[3], const int16_t gyro[3]) {
+    int16_t a, g;
+    int i;
+
+    for(i = 0; i < 3; i++) {
+        a = (accl[i] * (1 << CAL_Q)) / ACCL_UNITS;
+        g = (gyro[i] * (1 << CAL_Q)) / GYRO_UNITS;
+        qmiFifo[i * 2]         = a;
+        qmiFifo[i * 2 + 1]     = a >> 8;
+        qmiFifo[i * 2 + 6]     = g;
+        qmiFifo[i * 2 + 7]     = g >> 8;
+    }
+    qmiCount[0] = QMI_FIFO_FRAME / 2;
+    qmiCount[1] = 0;
+    qmiDataTxn.rxLen = QMI_FIFO_FRAME;
+    qmiDataTxn.status = IQ_OK;
+    qmiCountTxn.status = IQ_OK;
+    qmiTsTxn.status = IQ_OK;
+    qmiDataTxn.doneUs = time_us_32();
+    qmiReadUs = time_us_64();
+    tlAddPrio(&tl, TL_HIGH, qmiDoneTxn.callback, &qmiDoneTxn);
+    runTasks();
+}
+
+/* Replays the whole CSV */
+static void replay(const char * path) {
+    char line[128];
+    uint32_t t, last = 0, pres, filt;
+    int32_t temp, delta;
+    int16_t accl[3], gyro[3];
+    struct timespec start, end;
+    FILE * f = fopen(path, "r");
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, path);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while(fgets(line, sizeof(line), f)) {
+        if(sscanf(line, "IMU, %u, %hd, %hd, %hd, %u, %hd, %hd, %hd", &t,
+                  &accl[0], &accl[1], &accl[2], &filt,
+                  &gyro[0], &gyro[1], &gyro[2]) == 8) {
+            advanceTo(t);
+            injectImu(accl, gyro);
+            rp.imu++;
+            if(t > rp.fullFrom && rp.fullFrom && !rp.fullTo)
+                rp.fullImu++;
+            if(rp.landedAt && t > rp.landedAt)
+                rp.landedImu++;
+        } else if(sscanf(line, "BARO, %u, %u, %d, %d", &t,
+                         &pres, &temp, &delta) == 4) {
+            advanceTo(t);
+            injectBaro(pres, temp);
+            rp.baro++;
+            if(!rp.groundPres)
+                rp.groundPres = pres;
+            rp.apogee = MAX(rp.apogee, 4433077 * (1 - pow((double) pres
+                            / rp.groundPres, 0.190263)));
+        } else {
+            continue;
+        }
+        last = t;
+
+        // Everything from launch to the main (or landing when theres no
+        // main) is logged at full rate
+        noteState();
+        if(state == BOOST && !rp.fullFrom)
+            rp.fullFrom = t;
+        if((state == MAIN_OUT || state == LANDED) && !rp.fullTo)
+            rp.fullTo = t;
+        if(state == LANDED && !rp.landedAt)
+            rp.landedAt = t;
+    }
+    fclose(f);
+
+    advanceTo(last + REPLAY_TAIL_MS);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    rp.hostS = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/* Reads the log back */
+static void readBack(void) {
+    log_t l;
+
+    rb.estQ0Min = INT16_MAX;
+    fRewind();
+    while(!fRead(&l)) {
+        switch(l.type) {
+        case IMU:
+            rb.imu++;
+            if(l.data.imu.time < rb.lastImu)
+                rb.imuBackwards++;
+            rb.lastImu = l.data.imu.time;
+            if(l.data.imu.time > rp.fullFrom && l.data.imu.time <= rp.fullTo)
+                rb.fullImu++;
+            if(rp.landedAt && l.data.imu.time > rp.landedAt)
+                rb.landedImu++;
+            break;
+        case BARO:
+            rb.baro++;
+            break;
+        case EST:
+            rb.est++;
+            rb.estApogee = MAX(rb.estApogee, l.data.est.alt);
+            rb.estVelMax = MAX(rb.estVelMax, l.data.est.vVel);
+            rb.estQ0Min = MIN(rb.estQ0Min, abs(l.data.est.quat[0]));
+            break;
+        case EVENT:
+            rb.events++;
+            if(rb.nStates < sizeof(rb.states) - 1)
+                rb.states[rb.nStates++] = l.data.event.state;
+            break;
+        default:
+            rb.other++;
+            break;
+        }
+    }
+}
+
+/* ------------------------ TESTS ----------------------- */
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static void testStates(void) {
+    char * b = strchr(rp.states, BOOST);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(b, "Never launched");
+    TEST_ASSERT_EQUAL_CHAR(LANDED, rp.states[rp.nStates - 1]);
+    if(rp.sim)
+        TEST_ASSERT_EQUAL_STRING(REPLAY_STATES, rp.states + 1);
+
+    // Every state change from launch on reaches flash, in order
+    TEST_ASSERT_EQUAL_STRING(b, strchr(rb.states, BOOST));
+}
+
+static void testNothingLost(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, fDropped());
+    TEST_ASSERT_EQUAL_UINT32(0, tlDropped(&tl, TL_HIGH));
+    TEST_ASSERT_EQUAL_UINT32(0, tlDropped(&tl, TL_NORM));
+    TEST_ASSERT_EQUAL_UINT32(0, mockFlashFaults());
+}
+
+static void testFullRate(void) {
+    TEST_ASSERT_NOT_EQUAL(0, rp.fullImu);
+    TEST_ASSERT_EQUAL_UINT32(rp.fullImu, rb.fullImu);
+    TEST_ASSERT_EQUAL_UINT32(0, rb.imuBackwards);
+}
+
+static void testAfterLanding(void) {
+    session_t sess;
+    char msg[80];
+
+    // Landed logging is decimated, but it still reaches flash
+    snprintf(msg, sizeof(msg), "%u of %u IMU samples logged after landing",
+             rb.landedImu, rp.landedImu);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_NOT_EQUAL(0, rp.landedImu);
+    TEST_ASSERT_NOT_EQUAL(0, rb.landedImu);
+    TEST_ASSERT_TRUE(rb.landedImu < rp.landedImu);
+
+    // and the flight is closed once F_LANDED_MS is up
+    TEST_ASSERT_EQUAL_INT(0, fGetSession(0, &sess));
+    TEST_ASSERT_NOT_EQUAL(0xFFFFFFFF, sess.records);
+}
+
+static void testEstimate(void) {
+    TEST_ASSERT_NOT_EQUAL(0, rb.est);
+    TEST_ASSERT_INT_WITHIN(rp.apogee / 20, rp.apogee, rb.estApogee);
+    if(!rp.sim)
+        return;
+
+    TEST_ASSERT_TRUE(rb.estQ0Min > EST_UPRIGHT);
+    TEST_ASSERT_INT_WITHIN(REPLAY_BURNOUT / 20, REPLAY_BURNOUT, rb.estVelMax);
+}
+
+/* More frames built up than IMU_BATCH, as after a long flash erase. The
+ * first read has to leave the newest frames for the next one, and stamp
+ * what it did read as older than them. */
+static void testFifoBacklog(void) {
+    uint32_t first, imuLat, baroLat;
+
+    // Starts the worst latency again, the replay is done with the state
+    detectInit(&config);
+    imuOdrUs = 1000;
+    memset(qmiFifo, 0, sizeof(qmiFifo));
+    qmiTs[0] = 0x34;
+    qmiTs[1] = 0x12;
+    qmiTs[2] = 0;
+    qmiDataTxn.status = IQ_OK;
+    qmiCountTxn.status = IQ_OK;
+    qmiTsTxn.status = IQ_OK;
+    qmiReadUs = time_us_64();
+
+    qmiCount[0] = (IMU_BATCH + 4) * QMI_FIFO_FRAME / 2;
+    qmiCount[1] = 0;
+    qmiDataTxn.rxLen = IMU_BATCH * QMI_FIFO_FRAME;
+    qmiDone(NULL);
+    first = imuData.time;
+    TEST_ASSERT_EQUAL_UINT32((qmiReadUs - 4 * imuOdrUs) / 1000, first);
+
+    // Latency counts from when the oldest sample was taken, not the read
+    detectLatency(&imuLat, &baroLat);
+    TEST_ASSERT_EQUAL_UINT32(19 * imuOdrUs, imuLat);
+
+    // The other 4, with nothing new sampled in between
+    qmiCount[0] = 4 * QMI_FIFO_FRAME / 2;
+    qmiDataTxn.rxLen = 4 * QMI_FIFO_FRAME;
+    qmiDone(NULL);
+    TEST_ASSERT_EQUAL_UINT32(qmiReadUs / 1000, imuData.time);
+    TEST_ASSERT_TRUE(imuData.time > first);
+
+    // Read past where the 32 bit us timer wraps, about 71.6 min in. The ms
+    // time has to carry on from there, the way the baro's does.
+    qmiReadUs = (1ULL << 32) + 5000;
+    qmiCount[0] = QMI_FIFO_FRAME / 2;
+    qmiDataTxn.rxLen = QMI_FIFO_FRAME;
+    qmiDone(NULL);
+    TEST_ASSERT_EQUAL_UINT32(qmiReadUs / 1000, imuData.time);
+    imuOdrUs = 0;
+}
+
+static void testReport(void) {
+    char msg[160];
+    traceStat_t ft;
+    uint32_t records = rb.imu + rb.baro + rb.events + rb.est + rb.other;
+    uint32_t pages = mockPrograms();
+
+    traceGet(TR_FTASK, &ft);
+    snprintf(msg, sizeof(msg),
+             "%u IMU and %u baro replayed in %.3f s, %.0f samples/s",
+             rp.imu, rp.baro, rp.hostS, (rp.imu + rp.baro) / rp.hostS);
+    TEST_MESSAGE(msg);
+    snprintf(msg, sizeof(msg),
+             "%u records in %u pages, %.1f records/page, %d kiB used, "
+             "fTask ran %u times, deepest queue %u",
+             records, pages, pages ? (double) records / pages : 0.0,
+             fUsed(), ft.count, traceDepthMax(TQ_MAIN));
+    TEST_MESSAGE(msg);
+    snprintf(msg, sizeof(msg),
+             "Apogee %.1f m by the baro, %.1f m estimated, "
+             "%.1f m/s at burnout, %.1f degrees off upright at worst",
+             rp.apogee / 100.0, rb.estApogee / 100.0, rb.estVelMax / 10.0,
+             2 * acos(rb.estQ0Min / 16384.0) * 180 / M_PI);
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char ** argv) {
+    const char * path = getenv("BOB_REPLAY");
+    const char * mainPres = getenv("BOB_MAIN_PRES");
+    const char * imuUs = getenv("BOB_IMU_US");
+
+    rp.sim = path == NULL;
+    config.mainPres = mainPres ? atoi(mainPres)
+                    : rp.sim ? REPLAY_MAIN_PRES : 0;
+
+    mockReset();
+    tl = tlInit();
+    detectInit(&config);
+    fInit(&config);
+    setupTransactions();
+    biquadReset(&baroVel);
+    maInit(&acclAvg, acclBuf, ACCL_AVG);
+    calBuild(&acclCal, &config.acclCal, ACCL_UNITS);
+    calBuild(&gyroCal, &config.gyroCal, GYRO_UNITS);
+    calBuild(&compCal, &config.compCal, COMP_UNITS);
+    estInit(imuUs ? atoi(imuUs) : REPLAY_IMU_US);
+    list = &tl;
+
+    UNITY_BEGIN();
+    replay(path ? path : REPLAY_CSV);
+    readBack();
+    RUN_TEST(testStates);
+    RUN_TEST(testNothingLost);
+    RUN_TEST(testFullRate);
+    RUN_TEST(testAfterLanding);
+    RUN_TEST(testEstimate);
+    RUN_TEST(testFifoBacklog);
+    RUN_TEST(testReport);
+    return UNITY_END();
+}
@@ -0,0 +1,77 @@
+#include <unity.h>
+
+#include "taskList.h"
+
+/* Task list ordering and overflow */
+
+static taskList_t list;
+static char ran[TL_SIZE * TL_PRIOS + 1];
+static int nRan;
+
+static void taskA(void * data) {
+    ran[nRan++] = 'a';
+}
+
+static void taskB(void * data) {
+    ran[nRan++] = 'b';
+}
+
+static void taskC(void * data) {
+    ran[nRan++] = 'c';
+}
+
+static void runAll(void) {
+    while(!tlRun(&list));
+    ran[nRan] = '\0';
+}
+
+void setUp(void) {
+    list = tlInit();
+    nRan = 0;
+}
+
+void tearDown(void) {
+}
+
+static void testEmpty(void) {
+    TEST_ASSERT_EQUAL_UINT8(1, tlRun(&list));
+    TEST_ASSERT_EQUAL_UINT8(0, tlSize(&list));
+}
+
+static void testPriority(void) {
+    tlAddPrio(&list, TL_LOW, taskC, NULL);
+    tlAdd(&list, taskB, NULL);
+    tlAddPrio(&list, TL_HIGH, taskA, NULL);
+    tlAddPrio(&list, TL_LOW, taskC, NULL);
+    tlAddPrio(&list, TL_HIGH, taskA, NULL);
+
+    TEST_ASSERT_EQUAL_UINT8(5, tlSize(&list));
+    runAll();
+    TEST_ASSERT_EQUAL_STRING("aabcc", ran);
+}
+
+static void testOverflow(void) {
+    int i, added = 0;
+
+    // One slot of each queue is kept free to tell full from empty
+    for(i = 0; i < TL_SIZE; i++)
+        added += !tlAdd(&list, taskB, NULL);
+
+    TEST_ASSERT_EQUAL_INT(TL_SIZE - 1, added);
+    TEST_ASSERT_EQUAL_UINT32(1, tlDropped(&list, TL_NORM));
+    TEST_ASSERT_EQUAL_UINT32(0, tlDropped(&list, TL_HIGH));
+
+    // A full queue doesnt stop the others
+    TEST_ASSERT_EQUAL_UINT8(0, tlAddPrio(&list, TL_HIGH, taskA, NULL));
+    runAll();
+    TEST_ASSERT_EQUAL_CHAR('a', ran[0]);
+    TEST_ASSERT_EQUAL_INT(TL_SIZE, nRan);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(testEmpty);
+    RUN_TEST(testPriority);
+    RUN_TEST(testOverflow);
+    return UNITY_END();
+}
@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+"""Pulls a binary dump off Bob and turns it into the same CSV as the 'r'
+command.
+
+    bobdump.py /dev/ttyACM0 > flight.csv      # Ask Bob for a dump over USB
+    bobdump.py --file capture.bin > out.csv   # Decode a dump saved earlier
+    bobdump.py /dev/ttyACM0 --save raw.bin    # Keep the raw log as well
+
+Talking to the board needs pyserial. The frame and record formats are
+described in src/shell.c and src/flash.c.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"BOBD"
+FRAME = struct.Struct("<IH")   # offset, length
+PAGE = 256
+SECTOR = 4096
+SECT = ord("s")
+
+HEADER = ("BARO, time, pres, temp, delta\n"
+          "IMU, time, acc x, acc y, acc z, acc filt, gyro x, gyro y, gyro z\n"
+          "COMP, time, x, y, z\n"
+          "GPS, time, hrs, mins, sec, lat, lng, sats\n"
+          "EVENT, time, state, latency us\n"
+          "EST, time, q w, q x, q y, q z, alt cm, vel dm/s\n")
+
+# Field layouts of each record, in the order fGetFields uses for DELTA.
+TYPES = {
+    ord("i"): ("IMU",  "<Ihhhhhhi"),
+    ord("c"): ("COMP", "<Ihhh"),
+    ord("b"): ("BARO", "<IIii"),
+}
+GPS = struct.Struct("<I3BiiH")
+DELTA = ord("z")
+GPS_TYPE = ord("g")
+EVENT = struct.Struct("<IBI")
+EVENT_TYPE = ord("e")
+EST = struct.Struct("<Ihhhhih")
+EST_TYPE = ord("q")
+
+
+def wrap(value, code):
+    """Truncates value to the width of a struct field, like C does."""
+    bits = struct.calcsize(code) * 8
+    value &= (1 << bits) - 1
+    if code.islower() and value >= 1 << (bits - 1):
+        value -= 1 << bits
+    return value
+
+
+def varint(data, pos):
+    """Reads a zig-zag varint. Returns the value and the new position."""
+    z = shift = 0
+    for _ in range(5):
+        b = data[pos]
+        pos += 1
+        z |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            break
+    return (z >> 1) ^ -(z & 1), pos
+
+
+def unwrap(log):
+    """Puts the sectors of a ring log back in order using the SECT record at
+    the start of each one. Blank sectors are dropped. Logs without sector
+    headers are left as they are."""
+    sectors = []
+    for base in range(0, len(log), SECTOR):
+        sector = log[base:base + SECTOR]
+        if len(sector) >= 7 and sector[0] == 0xAA and sector[2] == SECT:
+            seq, = struct.unpack_from("<I", sector, 3)
+            sectors.append((seq, sector))
+
+    if not sectors:
+        return log
+    return b"".join(sector for _, sector in sorted(sectors, key=lambda s: s[0]))
+
+
+def records(log):
+    """Yields (type, fields) for every record in a raw log, expanding DELTA
+    records the same way fRead does."""
+    last = {}
+    pos = 0
+
+    while pos + 3 <= len(log):
+        if log[pos] != 0xAA:
+            # Records never straddle a page, the rest of it is padding.
+            if pos % PAGE:
+                pos = (pos | (PAGE - 1)) + 1
+                continue
+            break
+
+        size, kind = log[pos + 1], log[pos + 2]
+        body = log[pos + 3:pos + 3 + size]
+        pos += 3 + size
+
+        if kind == DELTA:
+            base = body[0]
+            if base not in TYPES or base not in last:
+                continue
+            fmt = TYPES[base][1]
+            fields = list(last[base])
+            p = 1
+            for i in range(len(fields)):
+                if p >= len(body):
+                    break
+                d, p = varint(body, p)
+                fields[i] = wrap(fields[i] + d, fmt[i + 1])
+            kind = base
+        elif kind in TYPES:
+            fmt = TYPES[kind][1]
+            if size != struct.calcsize(fmt):
+                continue
+            fields = list(struct.unpack(fmt, body))
+        elif kind == GPS_TYPE and size == GPS.size:
+            yield kind, GPS.unpack(body)
+            continue
+        elif kind == EVENT_TYPE and size == EVENT.size:
+            yield kind, EVENT.unpack(body)
+            continue
+        elif kind == EST_TYPE and size == EST.size:
+            yield kind, EST.unpack(body)
+            continue
+        else:
+            continue
+
+        last[kind] = fields
+        yield kind, fields
+
+
+def csv(log, out):
+    out.write(HEADER)
+    for kind, f in records(log):
+        if kind == ord("b"):
+            out.write("BARO, %u, %u, %d, %d\n" % tuple(f))
+        elif kind == ord("i"):
+            # Same column order as the dump: accl, acclFilt, gyro
+            out.write("IMU, %u, %d, %d, %d, %d, %d, %d, %d\n"
+                      % (f[0], f[1], f[2], f[3], f[7], f[4], f[5], f[6]))
+        elif kind == ord("c"):
+            out.write("COMP, %u, %d, %d, %d\n" % tuple(f))
+        elif kind == GPS_TYPE:
+            # lon is stored before lat
+            out.write("GPS, %u, %u, %u, %u, %d, %d, %u\n"
+                      % (f[0], f[1], f[2], f[3], f[5], f[4], f[6]))
+        elif kind == EVENT_TYPE:
+            out.write("EVENT, %u, %c, %u\n" % (f[0], chr(f[1]), f[2]))
+        elif kind == EST_TYPE:
+            out.write("EST, %u, %d, %d, %d, %d, %d, %d\n" % f)
+
+
+def frames(read):
+    """Reassembles the log from a stream of frames. read(n) must return
+    exactly n bytes. Anything before the first frame is skipped."""
+    log = bytearray()
+    window = b""
+
+    while True:
+        # Hunt for the magic, ignoring any shell chatter in front of it.
+        window = (window + read(1))[-len(MAGIC):]
+        if window != MAGIC:
+            continue
+        window = b""
+
+        head = read(FRAME.size)
+        offset, length = FRAME.unpack(head)
+        data = read(length)
+        crc, = struct.unpack("<I", read(4))
+
+        if zlib.crc32(head + data) != crc:
+            sys.exit("CRC error in frame at offset %d" % offset)
+        if offset != len(log):
+            sys.exit("Missing data at offset %d" % len(log))
+        if length == 0:
+            return bytes(log)
+
+        log += data
+        print("\r%d kiB" % (len(log) >> 10), end="", file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port", nargs="?", help="Bob's USB serial port")
+    parser.add_argument("--file", help="decode a raw log saved with --save")
+    parser.add_argument("--save", help="also save the raw log here")
+    args = parser.parse_args()
+
+    if args.file:
+        with open(args.file, "rb") as f:
+            log = f.read()
+    elif args.port:
+        import serial
+        with serial.Serial(args.port, timeout=5) as port:
+            port.reset_input_buffer()
+            port.write(b"x")
+
+            def read(n):
+                data = port.read(n)
+                if len(data) != n:
+                    sys.exit("Timed out waiting for Bob")
+                return data
+
+            log = frames(read)
+            print(file=sys.stderr)
+    else:
+        parser.error("give either a port or --file")
+
+    if args.save:
+        with open(args.save, "wb") as f:
+            f.write(log)
+
+    csv(unwrap(log), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()